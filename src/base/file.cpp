@@ -461,6 +461,86 @@ bool SaveToFile(const std::string& data, const std::wstring& path,
   return SaveToFile((LPCVOID)&data.front(), data.size(), path, take_backup);
 }
 
+bool AppendToFile(const std::string& data, const std::wstring& path) {
+  if (data.empty())
+    return false;
+
+  // Make sure the path is available
+  CreateFolder(GetPathOnly(path));
+
+  // Append the data, creating the file if it doesn't exist
+  Handle file_handle{::CreateFile(GetExtendedLengthPath(path).c_str(),
+                                  FILE_APPEND_DATA, 0, nullptr, OPEN_ALWAYS,
+                                  FILE_ATTRIBUTE_NORMAL, nullptr)};
+  if (file_handle.get() == INVALID_HANDLE_VALUE)
+    return false;
+
+  // A short write leaves a partial record behind, which is just as bad as
+  // not writing at all
+  DWORD bytes_written = 0;
+  const BOOL result = ::WriteFile(file_handle.get(), data.data(),
+                                  static_cast<DWORD>(data.size()),
+                                  &bytes_written, nullptr);
+
+  return result != FALSE && bytes_written == data.size();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+MappedFile::~MappedFile() {
+  Close();
+}
+
+bool MappedFile::Open(const std::wstring& path) {
+  Close();
+
+  Handle file_handle{OpenFileForGenericRead(path)};
+
+  if (file_handle.get() == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER file_size{};
+  if (::GetFileSizeEx(file_handle.get(), &file_size) == FALSE ||
+      file_size.QuadPart == 0)
+    return false;
+
+  // The mapping keeps a reference to the file, so we don't need to keep the
+  // file handle open.
+  mapping_ = ::CreateFileMapping(file_handle.get(), nullptr, PAGE_READONLY,
+                                 0, 0, nullptr);
+  if (!mapping_)
+    return false;
+
+  data_ = static_cast<const char*>(
+      ::MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+  if (!data_) {
+    Close();
+    return false;
+  }
+
+  size_ = static_cast<size_t>(file_size.QuadPart);
+  return true;
+}
+
+void MappedFile::Close() {
+  if (data_)
+    ::UnmapViewOfFile(data_);
+  if (mapping_)
+    ::CloseHandle(mapping_);
+
+  mapping_ = nullptr;
+  data_ = nullptr;
+  size_ = 0;
+}
+
+const char* MappedFile::data() const {
+  return data_;
+}
+
+size_t MappedFile::size() const {
+  return size_;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 enum Unit : UINT64 {
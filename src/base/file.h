@@ -22,11 +22,14 @@
 #include <string>
 #include <vector>
 
+#ifdef _WIN32
 #include <windows.h>
 #include <shlobj.h>
+#endif
 
 #include "types.h"
 
+#ifdef _WIN32
 unsigned long GetFileAge(const std::wstring& path);
 std::wstring GetFileLastModifiedDate(const std::wstring& path);
 QWORD GetFileSize(const std::wstring& path);
@@ -36,7 +39,9 @@ bool Execute(const std::wstring& path, const std::wstring& parameters = L"", int
 bool ExecuteLink(const std::wstring& link);
 
 bool OpenFolderAndSelectFile(const std::wstring& path);
+#endif
 bool CreateFolder(const std::wstring& path);
+#ifdef _WIN32
 int DeleteFolder(std::wstring path);
 
 std::wstring GetExtendedLengthPath(const std::wstring& path);
@@ -58,11 +63,40 @@ std::wstring GetFinalPath(const std::wstring& path);
 
 unsigned int PopulateFiles(std::vector<std::wstring>& file_list, const std::wstring& path, const std::wstring& extension = L"", bool recursive = false, bool trim_extension = false);
 int PopulateFolders(std::vector<std::wstring>& folder_list, const std::wstring& path);
+#endif
 
 bool ReadFromFile(const std::wstring& path, std::string& output);
+#ifdef _WIN32
 bool SaveToFile(LPCVOID data, DWORD length, const std::wstring& path, bool take_backup = false);
+#endif
 bool SaveToFile(const std::string& data, const std::wstring& path, bool take_backup = false);
+#ifdef _WIN32
+bool AppendToFile(const std::string& data, const std::wstring& path);
+#endif
 
+// Read-only view of a file that is mapped into memory
+class MappedFile {
+public:
+  MappedFile() {}
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  ~MappedFile();
+
+  bool Open(const std::wstring& path);
+  void Close();
+
+  const char* data() const;
+  size_t size() const;
+
+private:
+#ifdef _WIN32
+  HANDLE mapping_ = nullptr;
+#endif
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+#ifdef _WIN32
 UINT64 ParseSizeString(std::wstring value);
 std::wstring ToSizeString(const UINT64 size);
 
@@ -92,3 +126,4 @@ protected:
   bool skip_files_;
   bool skip_subdirectories_;
 };
+#endif
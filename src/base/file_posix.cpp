@@ -0,0 +1,118 @@
+/*
+** Taiga
+** Copyright (C) 2010-2018, Eren Okka
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// The parts of file.cpp that the headless build needs, for platforms other
+// than Windows
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "file.h"
+#include "string.h"
+
+bool CreateFolder(const std::wstring& path) {
+  std::error_code error;
+  std::filesystem::create_directories(WstrToStr(path), error);
+  return !error;
+}
+
+bool ReadFromFile(const std::wstring& path, std::string& output) {
+  std::ifstream file(WstrToStr(path), std::ios::in | std::ios::binary);
+
+  if (!file)
+    return false;
+
+  output.assign(std::istreambuf_iterator<char>(file),
+                std::istreambuf_iterator<char>());
+
+  return !file.bad();
+}
+
+bool SaveToFile(const std::string& data, const std::wstring& path,
+                bool take_backup) {
+  if (data.empty())
+    return false;
+
+  // Make sure the path is available
+  CreateFolder(GetPathOnly(path));
+
+  // Take a backup if needed
+  if (take_backup) {
+    std::error_code error;
+    std::filesystem::rename(WstrToStr(path), WstrToStr(path + L".bak"), error);
+  }
+
+  // Save the data
+  std::ofstream file(WstrToStr(path), std::ios::out | std::ios::binary);
+  file.write(data.data(), data.size());
+
+  return file.good();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+MappedFile::~MappedFile() {
+  Close();
+}
+
+bool MappedFile::Open(const std::wstring& path) {
+  Close();
+
+  const int file = ::open(WstrToStr(path).c_str(), O_RDONLY);
+
+  if (file < 0)
+    return false;
+
+  // The mapping keeps a reference to the file, so we don't need to keep the
+  // file descriptor open.
+  struct stat file_status{};
+  if (::fstat(file, &file_status) == 0 && file_status.st_size > 0) {
+    void* data = ::mmap(nullptr, file_status.st_size, PROT_READ, MAP_PRIVATE,
+                        file, 0);
+    if (data != MAP_FAILED) {
+      data_ = static_cast<const char*>(data);
+      size_ = static_cast<size_t>(file_status.st_size);
+    }
+  }
+
+  ::close(file);
+
+  return data_ != nullptr;
+}
+
+void MappedFile::Close() {
+  if (data_)
+    ::munmap(const_cast<char*>(data_), size_);
+
+  data_ = nullptr;
+  size_ = 0;
+}
+
+const char* MappedFile::data() const {
+  return data_;
+}
+
+size_t MappedFile::size() const {
+  return size_;
+}
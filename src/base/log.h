@@ -33,9 +33,9 @@ void Log(const monolog::Level level, const monolog::Source& source,
 }  // namespace base
 
 #define TAIGA_LOG(level, text, ...) \
-    base::Log(level, monolog::Source{__FILE__, __FUNCTION__, __LINE__}, text, __VA_ARGS__)
+    base::Log(level, monolog::Source{__FILE__, __FUNCTION__, __LINE__}, text, ##__VA_ARGS__)
 
-#define LOGD(text, ...) TAIGA_LOG(monolog::Level::Debug, text, __VA_ARGS__)
-#define LOGI(text, ...) TAIGA_LOG(monolog::Level::Informational, text, __VA_ARGS__)
-#define LOGW(text, ...) TAIGA_LOG(monolog::Level::Warning, text, __VA_ARGS__)
-#define LOGE(text, ...) TAIGA_LOG(monolog::Level::Error, text, __VA_ARGS__)
+#define LOGD(text, ...) TAIGA_LOG(monolog::Level::Debug, text, ##__VA_ARGS__)
+#define LOGI(text, ...) TAIGA_LOG(monolog::Level::Informational, text, ##__VA_ARGS__)
+#define LOGW(text, ...) TAIGA_LOG(monolog::Level::Warning, text, ##__VA_ARGS__)
+#define LOGE(text, ...) TAIGA_LOG(monolog::Level::Error, text, ##__VA_ARGS__)
@@ -0,0 +1,131 @@
+/*
+** Taiga
+** Copyright (C) 2010-2018, Eren Okka
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "parallel.h"
+
+namespace base {
+
+namespace {
+
+struct Job {
+  Job(size_t count, const std::function<void(size_t)>& function)
+      : count(count), function(function) {}
+
+  const size_t count;
+  const std::function<void(size_t)>& function;
+  std::atomic<size_t> next_index{0};
+  std::atomic<size_t> finished_count{0};
+};
+
+class WorkerPool {
+public:
+  explicit WorkerPool(size_t thread_count) {
+    for (size_t i = 0; i < thread_count; ++i)
+      std::thread([this]() { Work(); }).detach();
+  }
+
+  void Run(size_t count, const std::function<void(size_t)>& function) {
+    const auto job = std::make_shared<Job>(count, function);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      jobs_.push_back(job);
+    }
+    work_available_.notify_all();
+
+    // The calling thread could do all of the work by itself if it had to, so
+    // this can't deadlock even if every worker is busy with another job.
+    Process(*job);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    RemoveJob(job);
+    job_finished_.wait(lock, [&job]() {
+      return job->finished_count == job->count;
+    });
+  }
+
+private:
+  void Work() {
+    while (true) {
+      std::shared_ptr<Job> job;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        work_available_.wait(lock, [this]() { return !jobs_.empty(); });
+        job = jobs_.front();
+      }
+
+      Process(*job);
+
+      std::lock_guard<std::mutex> lock(mutex_);
+      RemoveJob(job);
+    }
+  }
+
+  void Process(Job& job) {
+    // The function may be gone once the last index is finished, so it is only
+    // called for indices that have been claimed before that.
+    for (size_t i = job.next_index++; i < job.count; i = job.next_index++) {
+      job.function(i);
+      if (++job.finished_count == job.count) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        job_finished_.notify_all();
+      }
+    }
+  }
+
+  // Jobs are removed by whoever runs out of indices first
+  void RemoveJob(const std::shared_ptr<Job>& job) {
+    const auto it = std::find(jobs_.begin(), jobs_.end(), job);
+    if (it != jobs_.end())
+      jobs_.erase(it);
+  }
+
+  std::mutex mutex_;
+  std::condition_variable work_available_;
+  std::condition_variable job_finished_;
+  std::deque<std::shared_ptr<Job>> jobs_;
+};
+
+}  // namespace
+
+void ParallelFor(size_t count, const std::function<void(size_t)>& function) {
+  const size_t thread_count =
+      std::max(1u, std::thread::hardware_concurrency());
+
+  if (thread_count <= 1 || count <= 1) {
+    for (size_t i = 0; i < count; ++i)
+      function(i);
+    return;
+  }
+
+  // Never destroyed, as workers may still be waiting for jobs when the
+  // application exits
+  static auto pool = new WorkerPool(thread_count - 1);
+
+  pool->Run(count, function);
+}
+
+}  // namespace base
@@ -0,0 +1,35 @@
+/*
+** Taiga
+** Copyright (C) 2010-2018, Eren Okka
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <functional>
+
+namespace base {
+
+// Calls function(i) for each i in [0, count) on a pool of worker threads, and
+// returns after all calls are finished. Indices are handed out one at a time,
+// so that slow items don't hold up the rest of the workers. The calling thread
+// takes part in the work as well.
+//
+// Worker threads are started on first use and kept for the lifetime of the
+// application, so that thread-local state (e.g. parsers) survives between
+// calls. Calls may be made from multiple threads, and from within function.
+void ParallelFor(size_t count, const std::function<void(size_t)>& function);
+
+}  // namespace base
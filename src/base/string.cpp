@@ -17,7 +17,12 @@
 */
 
 #include <algorithm>
+#include <array>
+#include <bitset>
+#include <cstdlib>
+#include <cwchar>
 #include <functional>
+#include <iterator>
 #include <iomanip>
 #include <locale>
 #include <map>
@@ -122,7 +127,11 @@ wstring CharRight(const wstring& str, int length) {
 int CompareStrings(const wstring& str1, const wstring& str2,
                    bool case_insensitive, size_t max_count) {
   if (case_insensitive) {
+#ifdef _WIN32
     return _wcsnicmp(str1.c_str(), str2.c_str(), max_count);
+#else
+    return wcsncasecmp(str1.c_str(), str2.c_str(), max_count);
+#endif
   } else {
     return wcsncmp(str1.c_str(), str2.c_str(), max_count);
   }
@@ -251,29 +260,155 @@ bool SearchRegex(const wstring& str, const wstring& pattern) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+// Strings that fit in two machine words are compared with bit-parallel
+// algorithms, where each bit represents a position in the shorter string.
+// Longer strings fall back to the classic dynamic programming approach, which
+// is kept in the *_Reference functions. Both methods give the same results.
+
+static const size_t kWordBits = 64;
+
+// Bit masks of the positions where each character occurs in the pattern, in
+// words of 64 positions each
+template <size_t Words>
+class PatternMatchVector {
+public:
+  explicit PatternMatchVector(const wstring& pattern) {
+    std::fill(&ascii_[0][0], &ascii_[0][0] + 0x80 * Words, 0);
+    for (size_t i = 0; i < pattern.size(); ++i)
+      Insert(pattern[i], i / kWordBits,
+             static_cast<UINT64>(1) << (i % kWordBits));
+  }
+
+  UINT64 Get(const wchar_t c, const size_t word) const {
+    if (c < 0x80)
+      return ascii_[c][word];
+    for (size_t i = 0; i < other_count_; ++i)
+      if (other_[i].first == c)
+        return other_[i].second[word];
+    return 0;
+  }
+
+private:
+  void Insert(const wchar_t c, const size_t word, const UINT64 mask) {
+    if (c < 0x80) {
+      ascii_[c][word] |= mask;
+      return;
+    }
+    for (size_t i = 0; i < other_count_; ++i) {
+      if (other_[i].first == c) {
+        other_[i].second[word] |= mask;
+        return;
+      }
+    }
+    auto& other = other_[other_count_++];
+    other.first = c;
+    other.second.fill(0);
+    other.second[word] = mask;
+  }
+
+  UINT64 ascii_[0x80][Words];
+  std::pair<wchar_t, std::array<UINT64, Words>> other_[kWordBits * Words];
+  size_t other_count_ = 0;
+};
+
+static UINT64 GetLowBitMask(const size_t length) {
+  return length >= kWordBits ? ~static_cast<UINT64>(0) :
+                               (static_cast<UINT64>(1) << length) - 1;
+}
+
+// Bits of positions [begin, end) that fall into the given word
+static UINT64 GetWindowMask(const size_t begin, const size_t end,
+                            const size_t word) {
+  const size_t offset = word * kWordBits;
+  auto clamp = [offset](const size_t pos) {
+    return pos <= offset ? 0 : std::min(pos - offset, kWordBits);
+  };
+  return GetLowBitMask(clamp(end)) & ~GetLowBitMask(clamp(begin));
+}
+
+static size_t GetWordCount(const size_t length) {
+  return (length + kWordBits - 1) / kWordBits;
+}
+
+template <typename T>
+static vector<T>& GetScratchBuffer(vector<T>& buffer, const size_t size) {
+  buffer.assign(size, T());
+  return buffer;
+}
+
+static thread_local vector<size_t> scratch_buffer_1;
+static thread_local vector<size_t> scratch_buffer_2;
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Allison-Dix algorithm, as described by Hyyro (2004). Words are added with
+// carries, as if they were a single integer.
+template <size_t Words>
+static size_t LongestCommonSubsequenceLength_BitParallel(const wstring& pattern,
+                                                         const wstring& text) {
+  const PatternMatchVector<Words> pm(pattern);
+  UINT64 v[Words];
+  std::fill(std::begin(v), std::end(v), ~static_cast<UINT64>(0));
+
+  for (const auto c : text) {
+    UINT64 carry = 0;
+    for (size_t k = 0; k < Words; ++k) {
+      const UINT64 u = v[k] & pm.Get(c, k);
+      const UINT64 partial_sum = v[k] + u;
+      const UINT64 sum = partial_sum + carry;
+      carry = (partial_sum < v[k]) | (sum < partial_sum);
+      v[k] = sum | (v[k] - u);
+    }
+  }
+
+  size_t length = 0;
+  for (size_t k = 0; k < Words; ++k)
+    length += std::bitset<64>(~v[k] &
+                              GetWindowMask(0, pattern.size(), k)).count();
+  return length;
+}
+
 size_t LongestCommonSubsequenceLength(const wstring& str1,
                                       const wstring& str2) {
   if (str1.empty() || str2.empty())
     return 0;
 
+  const auto& pattern = str1.size() <= str2.size() ? str1 : str2;
+  const auto& text = str1.size() <= str2.size() ? str2 : str1;
+
+  switch (GetWordCount(pattern.size())) {
+    case 1:
+      return LongestCommonSubsequenceLength_BitParallel<1>(pattern, text);
+    case 2:
+      return LongestCommonSubsequenceLength_BitParallel<2>(pattern, text);
+    default:
+      return LongestCommonSubsequenceLength_Reference(str1, str2);
+  }
+}
+
+size_t LongestCommonSubsequenceLength_Reference(const wstring& str1,
+                                                const wstring& str2) {
+  if (str1.empty() || str2.empty())
+    return 0;
+
   const size_t len1 = str1.length();
   const size_t len2 = str2.length();
 
-  vector<vector<size_t>> table(len1 + 1);
-  for (auto it = table.begin(); it != table.end(); ++it)
-    it->resize(len2 + 1);
+  auto& prev_row = GetScratchBuffer(scratch_buffer_1, len2 + 1);
+  auto& row = GetScratchBuffer(scratch_buffer_2, len2 + 1);
 
   for (size_t i = 0; i < len1; i++) {
     for (size_t j = 0; j < len2; j++) {
       if (str1[i] == str2[j]) {
-        table[i + 1][j + 1] = table[i][j] + 1;
+        row[j + 1] = prev_row[j] + 1;
       } else {
-        table[i + 1][j + 1] = std::max(table[i + 1][j], table[i][j + 1]);
+        row[j + 1] = std::max(row[j], prev_row[j + 1]);
       }
     }
+    row.swap(prev_row);
   }
 
-  return table.back().back();
+  return prev_row.back();
 }
 
 size_t LongestCommonSubstringLength(const wstring& str1, const wstring& str2) {
@@ -283,25 +418,20 @@ size_t LongestCommonSubstringLength(const wstring& str1, const wstring& str2) {
   const size_t len1 = str1.length();
   const size_t len2 = str2.length();
 
-  vector<vector<size_t>> table(len1);
-  for (auto it = table.begin(); it != table.end(); ++it)
-    it->resize(len2);
+  // Length of the common suffix ending at each position of str2. We iterate
+  // backwards, so that a single row is enough.
+  auto& row = GetScratchBuffer(scratch_buffer_1, len2 + 1);
 
   size_t longest_length = 0;
 
   for (size_t i = 0; i < len1; i++) {
-    for (size_t j = 0; j < len2; j++) {
-      if (str1[i] == str2[j]) {
-        if (i == 0 || j == 0) {
-          table[i][j] = 1;
-        } else {
-          table[i][j] = table[i - 1][j - 1] + 1;
-        }
-        if (table[i][j] > longest_length) {
-          longest_length = table[i][j];
-        }
+    for (size_t j = len2; j > 0; j--) {
+      if (str1[i] == str2[j - 1]) {
+        row[j] = row[j - 1] + 1;
+        if (row[j] > longest_length)
+          longest_length = row[j];
       } else {
-        table[i][j] = 0;
+        row[j] = 0;
       }
     }
   }
@@ -311,21 +441,64 @@ size_t LongestCommonSubstringLength(const wstring& str1, const wstring& str2) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
-// Based on Miguel Serrano's Jaro-Winkler distance implementation
-// Licensed under GNU GPLv3 - Copyright (C) 2011 Miguel Serrano
-double JaroWinklerDistance(const wstring& str1, const wstring& str2) {
+// Matches each character of str2 to the first unmatched occurrence in str1
+// within range, using masks instead of looking at each position in the range
+template <size_t Words>
+static void CountJaroMatches_BitParallel(const wstring& str1,
+                                         const wstring& str2,
+                                         const int range, int& m, int& t) {
   const int len1 = str1.size();
   const int len2 = str2.size();
 
-  if (!len1 || !len2)
-    return 0.0;
+  const PatternMatchVector<Words> pm(str1);
+  UINT64 sflags[Words] = {};
+  UINT64 aflags[Words] = {};
+
+  // Calculate matching characters
+  for (int i = 0; i < len2; i++) {
+    const int begin = std::max(i - range, 0);
+    const int end = std::min(i + range + 1, len1);
+    if (begin >= end)
+      continue;
+    for (size_t k = 0; k < Words; ++k) {
+      const UINT64 candidates = pm.Get(str2[i], k) & ~sflags[k] &
+                                GetWindowMask(begin, end, k);
+      if (candidates) {
+        sflags[k] |= candidates & (0 - candidates);  // lowest set bit
+        aflags[i / kWordBits] |= static_cast<UINT64>(1) << (i % kWordBits);
+        m++;
+        break;
+      }
+    }
+  }
+  if (!m)
+    return;
+
+  // Calculate character transpositions
+  int j = 0;
+  for (int i = 0; i < len2; i++) {
+    if ((aflags[i / kWordBits] >> (i % kWordBits)) & 1) {
+      while (!((sflags[j / kWordBits] >> (j % kWordBits)) & 1))
+        j++;
+      if (str2[i] != str1[j])
+        t++;
+      j++;
+    }
+  }
+}
+
+static void CountJaroMatches_Reference(const wstring& str1,
+                                       const wstring& str2,
+                                       const int range, int& m, int& t) {
+  const int len1 = str1.size();
+  const int len2 = str2.size();
 
   int i, j, l;
-  int m = 0, t = 0;
-  vector<int> sflags(len1), aflags(len2);
+
+  auto& sflags = GetScratchBuffer(scratch_buffer_1, len1);
+  auto& aflags = GetScratchBuffer(scratch_buffer_2, len2);
 
   // Calculate matching characters
-  int range = std::max(0, (std::max(len1, len2) / 2) - 1);
   for (i = 0; i < len2; i++) {
     for (j = std::max(i - range, 0), l = std::min(i + range + 1, len1); j < l; j++) {
       if (str2[i] == str1[j] && !sflags[j]) {
@@ -337,7 +510,7 @@ double JaroWinklerDistance(const wstring& str1, const wstring& str2) {
     }
   }
   if (!m)
-    return 0.0;
+    return;
 
   // Calculate character transpositions
   l = 0;
@@ -353,6 +526,36 @@ double JaroWinklerDistance(const wstring& str1, const wstring& str2) {
         t++;
     }
   }
+}
+
+// Based on Miguel Serrano's Jaro-Winkler distance implementation
+// Licensed under GNU GPLv3 - Copyright (C) 2011 Miguel Serrano
+static double JaroWinklerDistance(const wstring& str1, const wstring& str2,
+                                  bool reference) {
+  const int len1 = str1.size();
+  const int len2 = str2.size();
+
+  if (!len1 || !len2)
+    return 0.0;
+
+  int i, l;
+  int m = 0, t = 0;
+
+  int range = std::max(0, (std::max(len1, len2) / 2) - 1);
+
+  switch (reference ? 0 : GetWordCount(std::max(len1, len2))) {
+    case 1:
+      CountJaroMatches_BitParallel<1>(str1, str2, range, m, t);
+      break;
+    case 2:
+      CountJaroMatches_BitParallel<2>(str1, str2, range, m, t);
+      break;
+    default:
+      CountJaroMatches_Reference(str1, str2, range, m, t);
+      break;
+  }
+  if (!m)
+    return 0.0;
   t /= 2;
 
   // Jaro distance
@@ -373,15 +576,69 @@ double JaroWinklerDistance(const wstring& str1, const wstring& str2) {
   return dw;
 }
 
-double LevenshteinDistance(const wstring& str1, const wstring& str2) {
+double JaroWinklerDistance(const wstring& str1, const wstring& str2) {
+  return JaroWinklerDistance(str1, str2, false);
+}
+
+double JaroWinklerDistance_Reference(const wstring& str1,
+                                     const wstring& str2) {
+  return JaroWinklerDistance(str1, str2, true);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Myers' algorithm, as described by Hyyro (2003). Horizontal differences are
+// carried over from one word to the next.
+template <size_t Words>
+static size_t LevenshteinDistance_BitParallel(const wstring& pattern,
+                                              const wstring& text) {
+  const PatternMatchVector<Words> pm(pattern);
+  const UINT64 last = static_cast<UINT64>(1) << ((pattern.size() - 1) % 64);
+  UINT64 pv[Words];
+  UINT64 mv[Words] = {};
+  std::fill(std::begin(pv), std::end(pv), ~static_cast<UINT64>(0));
+
+  size_t distance = pattern.size();
+
+  for (const auto c : text) {
+    UINT64 ph_carry = 1;
+    UINT64 mh_carry = 0;
+    for (size_t k = 0; k < Words; ++k) {
+      const UINT64 eq = pm.Get(c, k) | mh_carry;
+      const UINT64 d0 = (((eq & pv[k]) + pv[k]) ^ pv[k]) | eq | mv[k];
+      UINT64 ph = mv[k] | ~(d0 | pv[k]);
+      UINT64 mh = pv[k] & d0;
+      if (k == Words - 1) {
+        if (ph & last) {
+          ++distance;
+        } else if (mh & last) {
+          --distance;
+        }
+      }
+      const UINT64 ph_out = ph >> 63;
+      const UINT64 mh_out = mh >> 63;
+      ph = (ph << 1) | ph_carry;
+      mh = (mh << 1) | mh_carry;
+      ph_carry = ph_out;
+      mh_carry = mh_out;
+      pv[k] = mh | ~(d0 | ph);
+      mv[k] = ph & d0;
+    }
+  }
+
+  return distance;
+}
+
+static size_t LevenshteinDistance_Dp(const wstring& str1,
+                                     const wstring& str2) {
   const size_t len1 = str1.size();
   const size_t len2 = str2.size();
 
-  vector<size_t> prev_col(len2 + 1);
+  auto& prev_col = GetScratchBuffer(scratch_buffer_1, len2 + 1);
   for (size_t i = 0; i < prev_col.size(); i++)
     prev_col[i] = i;
 
-  vector<size_t> col(len2 + 1);
+  auto& col = GetScratchBuffer(scratch_buffer_2, len2 + 1);
 
   for (size_t i = 0; i < len1; i++) {
     col[0] = i + 1;
@@ -393,44 +650,94 @@ double LevenshteinDistance(const wstring& str1, const wstring& str2) {
     col.swap(prev_col);
   }
 
+  return prev_col[len2];
+}
+
+double LevenshteinDistance(const wstring& str1, const wstring& str2) {
+  const auto& pattern = str1.size() <= str2.size() ? str1 : str2;
+  const auto& text = str1.size() <= str2.size() ? str2 : str1;
+
+  size_t distance = 0;
+
+  switch (GetWordCount(pattern.size())) {
+    case 0:
+      distance = text.size();
+      break;
+    case 1:
+      distance = LevenshteinDistance_BitParallel<1>(pattern, text);
+      break;
+    case 2:
+      distance = LevenshteinDistance_BitParallel<2>(pattern, text);
+      break;
+    default:
+      distance = LevenshteinDistance_Dp(str1, str2);
+      break;
+  }
+
+  const double len = static_cast<double>(std::max(str1.size(), str2.size()));
+  return 1.0 - (distance / len);
+}
+
+double LevenshteinDistance_Reference(const wstring& str1,
+                                     const wstring& str2) {
+  const size_t distance = LevenshteinDistance_Dp(str1, str2);
   const double len = static_cast<double>(std::max(str1.size(), str2.size()));
-  return 1.0 - (prev_col[len2] / len);
+  return 1.0 - (distance / len);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
+trigram_t PackTrigram(wchar_t c1, wchar_t c2, wchar_t c3) {
+  // Packed values are ordered the same way as the code units they represent
+  return (static_cast<trigram_t>(static_cast<WORD>(c1)) << 32) |
+         (static_cast<trigram_t>(static_cast<WORD>(c2)) << 16) |
+         (static_cast<trigram_t>(static_cast<WORD>(c3)));
+}
+
 void GetTrigrams(const wstring& str, trigram_container_t& output) {
   const size_t n = 3;
 
-  if (n < 1)
-    return;
-
   output.clear();
 
   if (n >= str.size()) {
-    trigram_t buffer = {'\0'};
-    std::copy(str.begin(), str.end(), buffer.begin());
-    output.push_back(buffer);
+    output.push_back(PackTrigram(str.size() > 0 ? str[0] : L'\0',
+                                 str.size() > 1 ? str[1] : L'\0',
+                                 str.size() > 2 ? str[2] : L'\0'));
     return;
   }
 
-  for (size_t i = 0; i <= str.size() - n; ++i) {
-    trigram_t buffer = {'\0'};
-    std::copy(str.begin() + i, str.begin() + (i + n), buffer.begin());
-    output.push_back(buffer);
-  }
+  output.reserve(str.size() - n + 1);
+  for (size_t i = 0; i <= str.size() - n; ++i)
+    output.push_back(PackTrigram(str[i], str[i + 1], str[i + 2]));
 
   std::sort(output.begin(), output.end());
 }
 
-double CompareTrigrams(const trigram_container_t& t1,
-                       const trigram_container_t& t2) {
-  trigram_container_t intersection;
+size_t CountCommonTrigrams(const trigram_container_t& t1,
+                           const trigram_container_t& t2) {
+  // Equivalent to counting the output of std::set_intersection, but without
+  // allocating and without unpredictable branches in the loop.
+  const trigram_t* it1 = t1.data();
+  const trigram_t* it2 = t2.data();
+  const trigram_t* const end1 = it1 + t1.size();
+  const trigram_t* const end2 = it2 + t2.size();
+
+  size_t count = 0;
+
+  while (it1 != end1 && it2 != end2) {
+    const trigram_t a = *it1;
+    const trigram_t b = *it2;
+    count += a == b;
+    it1 += a <= b;
+    it2 += b <= a;
+  }
 
-  std::set_intersection(t1.begin(), t1.end(), t2.begin(), t2.end(),
-                        std::back_inserter(intersection));
+  return count;
+}
 
-  return static_cast<double>(intersection.size()) /
+double CompareTrigrams(const trigram_container_t& t1,
+                       const trigram_container_t& t2) {
+  return static_cast<double>(CountCommonTrigrams(t1, t2)) /
          static_cast<double>(std::max(t1.size(), t2.size()));
 }
 
@@ -582,6 +889,7 @@ size_t Tokenize(const wstring& str, const wstring& delimiters,
 ////////////////////////////////////////////////////////////////////////////////
 // std::string <-> std::wstring conversion
 
+#ifdef _WIN32
 wstring StrToWstr(const string& str, UINT code_page) {
   if (!str.empty()) {
     int length = MultiByteToWideChar(code_page, 0, str.c_str(), -1, nullptr, 0);
@@ -609,12 +917,77 @@ string WstrToStr(const wstring& str, UINT code_page) {
 
   return string();
 }
+#else
+// UTF-8 only, where wchar_t holds UTF-32. Invalid sequences are replaced with
+// U+FFFD, as MultiByteToWideChar does.
+wstring StrToWstr(const string& str, UINT) {
+  wstring output;
+  output.reserve(str.size());
+
+  for (size_t i = 0; i < str.size(); ) {
+    const auto c = static_cast<unsigned char>(str[i]);
+    const size_t length = c < 0x80 ? 1 : c < 0xC2 ? 0 : c < 0xE0 ? 2 :
+                          c < 0xF0 ? 3 : c < 0xF5 ? 4 : 0;
+    char32_t code_point = length == 1 ? c : length == 2 ? c & 0x1F :
+                          length == 3 ? c & 0x0F : c & 0x07;
+    size_t j = 1;
+    for (; j < length && i + j < str.size(); ++j) {
+      const auto trail = static_cast<unsigned char>(str[i + j]);
+      if ((trail & 0xC0) != 0x80)
+        break;
+      code_point = (code_point << 6) | (trail & 0x3F);
+    }
+    const bool valid = length && j == length &&
+        code_point >= (length == 2 ? 0x80u : length == 3 ? 0x800u :
+                       length == 4 ? 0x10000u : 0u) &&
+        code_point <= 0x10FFFF &&
+        (code_point < 0xD800 || code_point > 0xDFFF);
+    output.push_back(valid ? static_cast<wchar_t>(code_point) : L'\uFFFD');
+    i += std::max<size_t>(j, 1);
+  }
+
+  return output;
+}
+
+string WstrToStr(const wstring& str, UINT) {
+  string output;
+  output.reserve(str.size());
+
+  for (const auto c : str) {
+    auto code_point = static_cast<char32_t>(c);
+    if (code_point > 0x10FFFF || (code_point >= 0xD800 && code_point <= 0xDFFF))
+      code_point = 0xFFFD;
+    if (code_point < 0x80) {
+      output.push_back(static_cast<char>(code_point));
+    } else if (code_point < 0x800) {
+      output.push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+      output.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else if (code_point < 0x10000) {
+      output.push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+      output.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+      output.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else {
+      output.push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+      output.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+      output.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+      output.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    }
+  }
+
+  return output;
+}
+#endif
 
 ////////////////////////////////////////////////////////////////////////////////
 // Case conversion
 
+#ifdef _WIN32
 // System-default ANSI code page
 std::locale current_locale("");
+#else
+// The environment may name a locale that isn't installed
+std::locale current_locale;
+#endif
 
 void ToLower(wstring& str, bool use_locale) {
   if (use_locale) {
@@ -665,7 +1038,7 @@ double ToDouble(const string& str) {
 }
 
 double ToDouble(const wstring& str) {
-  return _wtof(str.c_str());
+  return std::wcstod(str.c_str(), nullptr);
 }
 
 int ToInt(const string& str) {
@@ -673,7 +1046,11 @@ int ToInt(const string& str) {
 }
 
 int ToInt(const wstring& str) {
+#ifdef _WIN32
   return _wtoi(str.c_str());
+#else
+  return static_cast<int>(std::wcstol(str.c_str(), nullptr, 10));
+#endif
 }
 
 UINT64 ToUint64(const std::string& str) {
@@ -685,47 +1062,37 @@ UINT64 ToUint64(const std::wstring& str) {
 }
 
 time_t ToTime(const std::string& str) {
-  return _atoi64(str.c_str());
+  return std::strtoll(str.c_str(), nullptr, 10);
 }
 
 time_t ToTime(const std::wstring& str) {
-  return _wtoi64(str.c_str());
+  return std::wcstoll(str.c_str(), nullptr, 10);
 }
 
 string ToStr(const INT& value) {
-  char buffer[65];
-  _ltoa_s(value, buffer, 65, 10);
-  return string(buffer);
+  return std::to_string(value);
 }
 
 wstring ToWstr(const INT& value) {
-  wchar_t buffer[65];
-  _ltow_s(value, buffer, 65, 10);
-  return wstring(buffer);
+  return std::to_wstring(value);
 }
 
 wstring ToWstr(const UINT& value) {
-  wchar_t buffer[65];
-  _ultow_s(value, buffer, 65, 10);
-  return wstring(buffer);
+  return std::to_wstring(value);
 }
 
+#ifdef _WIN32
 wstring ToWstr(const ULONG& value) {
-  wchar_t buffer[65];
-  _ultow_s(value, buffer, 65, 10);
-  return wstring(buffer);
+  return std::to_wstring(value);
 }
+#endif
 
 wstring ToWstr(const INT64& value) {
-  wchar_t buffer[65];
-  _i64tow_s(value, buffer, 65, 10);
-  return wstring(buffer);
+  return std::to_wstring(value);
 }
 
 wstring ToWstr(const UINT64& value) {
-  wchar_t buffer[65];
-  _ui64tow_s(value, buffer, 65, 10);
-  return wstring(buffer);
+  return std::to_wstring(value);
 }
 
 string ToStr(const double& value, int count) {
@@ -18,10 +18,14 @@
 
 #pragma once
 
-#include <array>
 #include <string>
 #include <vector>
+
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include "types.h"
+#endif
 
 void Erase(std::wstring& str1, const std::wstring& str2, bool case_insensitive = false);
 void EraseChars(std::wstring& str, const wchar_t chars[]);
@@ -61,10 +65,17 @@ size_t LongestCommonSubsequenceLength(const std::wstring& str1, const std::wstri
 size_t LongestCommonSubstringLength(const std::wstring& str1, const std::wstring& str2);
 double JaroWinklerDistance(const std::wstring& str1, const std::wstring& str2);
 double LevenshteinDistance(const std::wstring& str1, const std::wstring& str2);
+// Plain dynamic programming versions of the above, which must give the same
+// results. The ones above use them for strings that are too long.
+size_t LongestCommonSubsequenceLength_Reference(const std::wstring& str1, const std::wstring& str2);
+double JaroWinklerDistance_Reference(const std::wstring& str1, const std::wstring& str2);
+double LevenshteinDistance_Reference(const std::wstring& str1, const std::wstring& str2);
 
-typedef std::array<wchar_t, 3> trigram_t;
+typedef UINT64 trigram_t;  // three UTF-16 code units packed in 48 bits
 typedef std::vector<trigram_t> trigram_container_t;
+trigram_t PackTrigram(wchar_t c1, wchar_t c2, wchar_t c3);
 void GetTrigrams(const std::wstring& str, trigram_container_t& output);
+size_t CountCommonTrigrams(const trigram_container_t& t1, const trigram_container_t& t2);
 double CompareTrigrams(const trigram_container_t& t1, const trigram_container_t& t2);
 
 void ReplaceChar(std::wstring& str, const wchar_t c, const wchar_t replace_with);
@@ -97,7 +108,9 @@ time_t ToTime(const std::wstring& str);
 std::string ToStr(const INT& value);
 std::wstring ToWstr(const INT& value);
 std::wstring ToWstr(const UINT& value);
-std::wstring ToWstr(const ULONG& value);
+#ifdef _WIN32
+std::wstring ToWstr(const ULONG& value);  // same as UINT64 elsewhere
+#endif
 std::wstring ToWstr(const INT64& value);
 std::wstring ToWstr(const UINT64& value);
 std::string ToStr(const double& value, int count = 16);
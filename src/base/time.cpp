@@ -22,6 +22,12 @@
 #include "string.h"
 #include "time.h"
 
+#ifndef _WIN32
+static int localtime_s(std::tm* tm, const time_t* time) {
+  return localtime_r(time, tm) ? 0 : -1;
+}
+#endif
+
 Date::Date()
     : Date(0, 0, 0) {
 }
@@ -36,9 +42,11 @@ Date::Date(const std::wstring& date)
   }
 }
 
+#ifdef _WIN32
 Date::Date(const SYSTEMTIME& st)
     : year_(st.wYear), month_(st.wMonth), day_(st.wDay) {
 }
+#endif
 
 Date::Date(unsigned short year, unsigned short month, unsigned short day)
     : year_(year), month_(month), day_(day) {
@@ -62,6 +70,7 @@ Date::operator bool() const {
   return year() && month() && day();
 }
 
+#ifdef _WIN32
 Date::operator SYSTEMTIME() const {
   SYSTEMTIME st = {0};
   st.wYear = static_cast<WORD>(year());
@@ -70,6 +79,7 @@ Date::operator SYSTEMTIME() const {
 
   return st;
 }
+#endif
 
 Date::operator std::wstring() const {
   return to_string();
@@ -189,12 +199,17 @@ static void NeutralizeTimezone(tm& t) {
   static long timezone_difference = 0;
 
   if (!initialized) {
+#ifdef _WIN32
     _tzset();
     _get_timezone(&timezone_difference);
 
     long dst_difference = 0;
     _get_dstbias(&dst_difference);
     timezone_difference += dst_difference;
+#else
+    tzset();
+    timezone_difference = timezone;
+#endif
 
     initialized = true;
   }
@@ -295,9 +310,13 @@ std::wstring ConvertRfc822ToLocal(const std::wstring& datetime) {
   std::strftime(&result.at(0), result.size(),
                 "%a, %d %b %Y %H:%M:%S", &local_tm);
 
+#ifdef _WIN32
   TIME_ZONE_INFORMATION time_zone_info = {0};
   const auto time_zone_id = GetTimeZoneInformation(&time_zone_info);
   const auto bias = time_zone_info.Bias + time_zone_info.DaylightBias;
+#else
+  const auto bias = static_cast<int>(-local_tm.tm_gmtoff / 60);
+#endif
 
   std::wstring sign = bias <= 0 ? L"+" : L"-";
   int hh = std::abs(bias) / 60;
@@ -382,6 +401,7 @@ std::wstring GetRelativeTimeString(time_t unix_time, bool append_suffix) {
   return str;
 }
 
+#ifdef _WIN32
 void GetSystemTime(SYSTEMTIME& st, int utc_offset) {
   // Get current time, expressed in UTC
   GetSystemTime(&st);
@@ -410,6 +430,11 @@ Date GetDate() {
   GetLocalTime(&st);
   return Date(st);
 }
+#else
+Date GetDate() {
+  return GetDate(std::time(nullptr));
+}
+#endif
 
 Date GetDate(time_t unix_time) {
   std::tm tm;
@@ -421,6 +446,7 @@ Date GetDate(time_t unix_time) {
   return Date();
 }
 
+#ifdef _WIN32
 std::wstring GetTime(LPCWSTR format) {
   WCHAR buff[32];
   GetTimeFormat(LOCALE_SYSTEM_DEFAULT, 0, NULL, format, buff, 32);
@@ -447,6 +473,22 @@ std::wstring GetTimeJapan(LPCWSTR format) {
   GetTimeFormat(LOCALE_SYSTEM_DEFAULT, 0, &st_jst, format, buff, 32);
   return buff;
 }
+#else
+time_t GetLocalTimeFromGmt(const time_t gmt) {
+  std::tm tm;
+  if (!localtime_r(&gmt, &tm))
+    return gmt;
+  return gmt + tm.tm_gmtoff;
+}
+
+Date GetDateJapan() {
+  const time_t time = std::time(nullptr) + 9 * 60 * 60;  // JST is UTC+09
+  std::tm tm;
+  if (!gmtime_r(&time, &tm))
+    return Date();
+  return Date(1900 + tm.tm_year, tm.tm_mon + 1, tm.tm_mday);
+}
+#endif
 
 std::wstring ToDateString(Duration duration) {
   std::wstring date;
@@ -21,7 +21,10 @@
 #include <chrono>
 #include <ctime>
 #include <string>
+
+#ifdef _WIN32
 #include <windows.h>
+#endif
 
 #include <date/include/date/date.h>
 
@@ -31,7 +34,9 @@ class Date : public base::Comparable<Date> {
 public:
   Date();
   explicit Date(const std::wstring& date);
+#ifdef _WIN32
   explicit Date(const SYSTEMTIME& st);
+#endif
   explicit Date(unsigned short year, unsigned short month, unsigned short day);
 
   Date& operator=(const Date& date);
@@ -39,7 +44,9 @@ public:
   int operator-(const Date& date) const;
 
   explicit operator bool() const;
+#ifdef _WIN32
   explicit operator SYSTEMTIME() const;
+#endif
   explicit operator std::wstring() const;
   explicit operator date::year_month_day() const;
 
@@ -99,16 +106,22 @@ time_t ConvertIso8601(const std::wstring& datetime);
 time_t ConvertRfc822(const std::wstring& datetime);
 std::wstring ConvertRfc822ToLocal(const std::wstring& datetime);
 
+#ifdef _WIN32
 void GetSystemTime(SYSTEMTIME& st, int utc_offset = 0);
+#endif
 
 Date GetDate();
 Date GetDate(time_t unix_time);
+#ifdef _WIN32
 std::wstring GetTime(LPCWSTR format = L"HH':'mm':'ss");
+#endif
 
 time_t GetLocalTimeFromGmt(const time_t gmt);
 
 Date GetDateJapan();
+#ifdef _WIN32
 std::wstring GetTimeJapan(LPCWSTR format = L"HH':'mm':'ss");
+#endif
 
 std::wstring ToDateString(Duration duration);
 unsigned int ToDayCount(const Date& date);
@@ -52,4 +52,19 @@ typedef base::http::Request HttpRequest;
 typedef base::http::Response HttpResponse;
 
 // 64-bit integral data type (quadword)
-typedef unsigned __int64 QWORD, *LPQWORD;
+typedef std::uint64_t QWORD, *LPQWORD;
+
+#ifndef _WIN32
+// Windows data types that the portable parts of the base library are declared
+// with
+typedef unsigned short WORD;
+typedef int INT;
+typedef unsigned int UINT;
+typedef std::uint32_t UINT32;
+typedef unsigned long ULONG;
+typedef std::int64_t INT64;
+typedef std::uint64_t UINT64;
+
+#define CP_UTF8 65001
+#define MAX_PATH 260
+#endif
@@ -36,7 +36,7 @@ std::wstring XmlGetNodeAsString(pugi::xml_node node) {
 }
 
 int XmlReadIntValue(pugi::xml_node& node, const wchar_t* name) {
-  return _wtoi(node.child_value(name));
+  return ToInt(node.child_value(name));
 }
 
 std::wstring XmlReadStrValue(pugi::xml_node& node, const wchar_t* name) {
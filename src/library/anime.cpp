@@ -25,7 +25,7 @@ MyInformation::MyInformation()
       score(0),
       status(kNotInList),
       rewatched_times(0),
-      rewatching(FALSE),
+      rewatching(0),
       rewatching_ep(0) {
 }
 
@@ -37,8 +37,6 @@
 #include "ui/dlg/dlg_anime_list.h"
 #include "ui/ui.h"
 
-anime::Database AnimeDatabase;
-
 namespace anime {
 
 bool Database::LoadDatabase() {
@@ -62,6 +60,8 @@ bool Database::LoadDatabase() {
     ReadDatabaseInCompatibilityMode(document);
   }
 
+  Meow.InvalidateCache();
+
   return true;
 }
 
@@ -202,33 +202,6 @@ void Database::WriteDatabaseNode(xml_node& database_node) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
-Item* Database::FindItem(int id, bool log_error) {
-  if (IsValidId(id)) {
-    auto it = items.find(id);
-    if (it != items.end())
-      return &it->second;
-    if (log_error)
-      LOGE(L"Could not find ID: {}", id);
-  }
-
-  return nullptr;
-}
-
-Item* Database::FindItem(const std::wstring& id, enum_t service,
-                         bool log_error) {
-  if (!id.empty()) {
-    for (auto& pair : items)
-      if (id == pair.second.GetId(service))
-        return &pair.second;
-    if (log_error)
-      LOGE(L"Could not find ID: {}", id);
-  }
-
-  return nullptr;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
 void Database::ClearInvalidItems() {
   for (auto it = items.begin(); it != items.end(); ) {
     if (!anime::IsValidId(it->second.GetId()) ||
@@ -250,6 +223,7 @@ bool Database::DeleteItem(int id) {
 
   if (items.erase(id) > 0) {
     LOGW(L"ID: {} | Title: {}", id, title);
+    Meow.InvalidateCache();
 
     auto delete_history_items = [](int id, std::vector<HistoryItem>& items) {
       items.erase(std::remove_if(items.begin(), items.end(),
@@ -353,6 +327,9 @@ int Database::UpdateItem(const Item& new_item) {
         !new_item.GetEnglishTitle(false).empty() ||
         !new_item.GetJapaneseTitle().empty())
       Meow.UpdateTitles(*item);
+
+    // Episode counts and airing dates affect validation
+    Meow.InvalidateCache();
   }
 
   // Update user information
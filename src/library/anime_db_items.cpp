@@ -0,0 +1,55 @@
+/*
+** Taiga
+** Copyright (C) 2010-2018, Eren Okka
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// The parts of anime_db.cpp that don't depend on the rest of the application,
+// so that the headless build can use them
+
+#include "base/log.h"
+#include "library/anime_db.h"
+#include "library/anime_util.h"
+
+anime::Database AnimeDatabase;
+
+namespace anime {
+
+Item* Database::FindItem(int id, bool log_error) {
+  if (IsValidId(id)) {
+    auto it = items.find(id);
+    if (it != items.end())
+      return &it->second;
+    if (log_error)
+      LOGE(L"Could not find ID: {}", id);
+  }
+
+  return nullptr;
+}
+
+Item* Database::FindItem(const std::wstring& id, enum_t service,
+                         bool log_error) {
+  if (!id.empty()) {
+    for (auto& pair : items)
+      if (id == pair.second.GetId(service))
+        return &pair.second;
+    if (log_error)
+      LOGE(L"Could not find ID: {}", id);
+  }
+
+  return nullptr;
+}
+
+}  // namespace anime
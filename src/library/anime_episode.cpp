@@ -20,7 +20,9 @@
 #include "library/anime.h"
 #include "library/anime_db.h"
 #include "library/anime_episode.h"
+#ifndef TAIGA_HEADLESS
 #include "ui/menu.h"
+#endif
 
 anime::Episode CurrentEpisode;
 
@@ -40,7 +42,9 @@ void Episode::Clear() {
 void Episode::Set(int anime_id) {
   this->anime_id = anime_id;
   this->processed = false;
+#ifndef TAIGA_HEADLESS
   ui::Menus.UpdateAll(AnimeDatabase.FindItem(anime_id));
+#endif
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -25,8 +25,10 @@
 #include "library/anime_item.h"
 #include "library/anime_util.h"
 #include "library/history.h"
-#include "sync/sync.h"
+#include "sync/service.h"
+#ifndef TAIGA_HEADLESS
 #include "ui/ui.h"
+#endif
 
 anime::Database* anime::Item::database_ = &AnimeDatabase;
 
@@ -446,7 +448,7 @@ int Item::GetMyRewatchedTimes(bool check_queue) const {
 
 int Item::GetMyRewatching(bool check_queue) const {
   if (!my_info_.get())
-    return FALSE;
+    return 0;
 
   HistoryItem* history_item = check_queue ?
       SearchHistory(QueueSearch::Rewatching) : nullptr;
@@ -641,7 +643,9 @@ bool Item::SetEpisodeAvailability(int number, bool available,
       SetNextEpisodePath(path);
     }
 
+#ifndef TAIGA_HEADLESS
     ui::OnEpisodeAvailabilityChange(GetId());
+#endif
 
     return true;
   }
@@ -736,7 +740,11 @@ void Item::RemoveFromUserList() {
 ////////////////////////////////////////////////////////////////////////////////
 
 HistoryItem* Item::SearchHistory(QueueSearch search_mode) const {
+#ifdef TAIGA_HEADLESS
+  return nullptr;  // there is no history to search
+#else
   return History.queue.FindItem(GetId(), search_mode);
+#endif
 }
 
 }  // namespace anime
\ No newline at end of file
@@ -0,0 +1,352 @@
+/*
+** Taiga
+** Copyright (C) 2010-2018, Eren Okka
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// The parts of anime_util.cpp that don't depend on the rest of the
+// application, so that the headless build can use them
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "base/string.h"
+#include "base/time.h"
+#include "library/anime.h"
+#include "library/anime_episode.h"
+#include "library/anime_item.h"
+#include "library/anime_util.h"
+
+namespace anime {
+
+bool IsValidId(int anime_id) {
+  return anime_id > ID_UNKNOWN;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+SeriesStatus GetAiringStatus(const Item& item) {
+  auto assume_worst_case = [](Date date) {
+    if (!date.month()) date.set_month(12);
+    if (!date.day()) date.set_day(31);
+    return date;
+  };
+
+  const Date now = GetDateJapan();
+
+  if (!IsValidDate(item.GetDateStart()))
+    return kNotYetAired;
+  const Date start = assume_worst_case(item.GetDateStart());
+  if (now < start)
+    return kNotYetAired;
+
+  // We don't need to check the end date for single-episode anime
+  if (item.GetEpisodeCount() == 1)
+    return kFinishedAiring;
+
+  if (!IsValidDate(item.GetDateEnd()))
+    return kAiring;
+  const Date end = assume_worst_case(item.GetDateEnd());
+  if (now <= end)
+    return kAiring;
+
+  return kFinishedAiring;
+}
+
+bool IsAiredYet(const Item& item) {
+  switch (item.GetAiringStatus(false)) {
+    case kFinishedAiring:
+    case kAiring:
+      return true;
+  }
+
+  switch (GetAiringStatus(item)) {
+    case kFinishedAiring:
+    case kAiring:
+      return true;
+  }
+
+  return false;
+}
+
+bool IsFinishedAiring(const Item& item) {
+  if (item.GetAiringStatus(false) == kFinishedAiring)
+    return true;
+
+  if (GetAiringStatus(item) == kFinishedAiring)
+    return true;
+
+  return false;
+}
+
+int EstimateDuration(const Item& item) {
+  int duration = item.GetEpisodeLength();
+
+  if (duration <= 0) {
+    // Approximate duration in minutes
+    switch (item.GetType()) {
+      default:
+      case anime::kTv:      duration = 24; break;
+      case anime::kOva:     duration = 24; break;
+      case anime::kMovie:   duration = 90; break;
+      case anime::kSpecial: duration = 12; break;
+      case anime::kOna:     duration = 24; break;
+      case anime::kMusic:   duration =  5; break;
+    }
+  }
+
+  return duration;
+}
+
+int EstimateLastAiredEpisodeNumber(const Item& item) {
+  // Can't estimate for other types of anime
+  if (item.GetType() != kTv)
+    return 0;
+
+  // TV series air weekly, so the number of weeks that has passed since the day
+  // the series started airing gives us the last aired episode. Note that
+  // irregularities such as broadcasts being postponed due to sports events make
+  // this method unreliable.
+  const Date& date_start = item.GetDateStart();
+  if (date_start.year() && date_start.month() && date_start.day()) {
+    // To compensate for the fact that we don't know the airing hour,
+    // we substract one more day.
+    int date_diff = GetDateJapan() - date_start - 1;
+    if (date_diff > -1) {
+      const int episode_count = item.GetEpisodeCount();
+      const int number_of_weeks = date_diff / 7;
+      if (!IsValidEpisodeCount(episode_count) ||
+          number_of_weeks < episode_count) {
+        if (number_of_weeks < 13) {  // Not reliable for longer series
+          return number_of_weeks + 1;
+        }
+      } else {
+        return episode_count;
+      }
+    }
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int GetEpisodeHigh(const Episode& episode) {
+  return episode.episode_number_range().second;
+}
+
+int GetEpisodeLow(const Episode& episode) {
+  return episode.episode_number_range().first;
+}
+
+static std::wstring GetElementRange(anitomy::ElementCategory category,
+                                    const Episode& episode) {
+  const auto element_count = episode.elements().count(category);
+
+  if (element_count > 1) {
+    const auto range = episode.GetElementAsRange(category);
+    if (range.second > range.first)
+      return ToWstr(range.first) + L"-" + ToWstr(range.second);
+  }
+
+  if (element_count > 0)
+    return ToWstr(episode.GetElementAsInt(category));
+
+  return std::wstring();
+}
+
+std::wstring GetEpisodeRange(const Episode& episode) {
+  if (IsEpisodeRange(episode))
+    return ToWstr(GetEpisodeLow(episode)) + L"-" +
+           ToWstr(GetEpisodeHigh(episode));
+
+  if (!episode.elements().empty(anitomy::kElementEpisodeNumber))
+    return ToWstr(episode.episode_number());
+
+  return std::wstring();
+}
+
+std::wstring GetVolumeRange(const Episode& episode) {
+  return GetElementRange(anitomy::kElementVolumeNumber, episode);
+}
+
+std::wstring GetEpisodeRange(const number_range_t& range) {
+  if (range.second > range.first)
+    return ToWstr(range.first) + L"-" + ToWstr(range.second);
+
+  return ToWstr(range.first);
+}
+
+bool IsAllEpisodesAvailable(const Item& item) {
+  if (!IsValidEpisodeCount(item.GetEpisodeCount()))
+    return false;
+
+  int available_episode_count = item.GetAvailableEpisodeCount();
+  bool all_episodes_available = available_episode_count > 0;
+
+  for (int i = 1; i <= available_episode_count; i++) {
+    if (!item.IsEpisodeAvailable(i)) {
+      all_episodes_available = false;
+      break;
+    }
+  }
+
+  return all_episodes_available;
+}
+
+bool IsEpisodeRange(const Episode& episode) {
+  if (episode.elements().count(anitomy::kElementEpisodeNumber) < 2)
+    return false;
+  return GetEpisodeHigh(episode) > GetEpisodeLow(episode);
+}
+
+bool IsValidEpisodeCount(int number) {
+  return number > 0 && number < 1900;
+}
+
+bool IsValidEpisodeNumber(int number, int total) {
+  if ((number < 0) ||
+      (number > total && IsValidEpisodeCount(total)))
+    return false;
+
+  return true;
+}
+
+bool IsValidEpisodeNumber(int number, int total, int watched) {
+  if (!IsValidEpisodeNumber(number, total) ||
+      (number < watched) ||
+      (number == watched && total != 1))
+    return false;
+
+  return true;
+}
+
+std::wstring JoinEpisodeNumbers(const std::vector<int>& input) {
+  std::wstring output;
+
+  for (const auto& number : input) {
+    if (!output.empty())
+      output += L"-";
+    output += ToWstr(number);
+  }
+
+  return output;
+}
+
+void SplitEpisodeNumbers(const std::wstring& input, std::vector<int>& output) {
+  if (input.empty())
+    return;
+
+  std::vector<std::wstring> numbers;
+  Split(input, L"-", numbers);
+
+  for (const auto& number : numbers)
+    output.push_back(ToInt(number));
+}
+
+int GetLastEpisodeNumber(const Item& item) {
+  if (item.GetAiringStatus() == kFinishedAiring)
+    return item.GetEpisodeCount();
+
+  int number = 0;
+
+  // Estimate using user information
+  number = std::max(number, item.GetMyLastWatchedEpisode());
+  if (item.GetAvailableEpisodeCount() != item.GetEpisodeCount())
+    number = std::max(number, item.GetAvailableEpisodeCount());
+
+  // Estimate using local information
+  number = std::max(number, item.GetLastAiredEpisodeNumber());
+
+  // Estimate using airing dates of TV series
+  number = std::max(number, EstimateLastAiredEpisodeNumber(item));
+
+  return number;
+}
+
+int EstimateEpisodeCount(const Item& item) {
+  // If we already know the number, we don't need to estimate
+  if (item.GetEpisodeCount() > 0)
+    return item.GetEpisodeCount();
+
+  const int number = GetLastEpisodeNumber(item);
+
+  // Given all TV series aired in 2006-2016, most of them have their episodes
+  // spanning one or two seasons. Following is a table of top ten values:
+  //
+  //   Episodes    Seasons    Percent
+  //   ------------------------------
+  //         12          1      34.2%
+  //         13          1      18.5%
+  //         26          2       9.5%
+  //         25          2       5.5%
+  //         24          2       5.4%
+  //         52          4       2.9%
+  //         11          1       2.7%
+  //         10          1       2.6%
+  //         51          4       2.4%
+  //         39          3       1.4%
+  //   ------------------------------
+  //   Total:                   85.1%
+  //
+  // With that in mind, we can normalize our output at several points.
+  if (number < 12) return 12;
+  if (number < 24) return 26;
+  if (number < 50) return 52;
+
+  // This is a series that has aired for more than a year, which means we cannot
+  // estimate for how long it is going to continue.
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+std::wstring TranslateStatus(int value) {
+  switch (value) {
+    case kAiring: return L"Currently airing";
+    case kFinishedAiring: return L"Finished airing";
+    case kNotYetAired: return L"Not yet aired";
+    default: return ToWstr(value);
+  }
+}
+
+std::wstring TranslateType(int value) {
+  switch (value) {
+    case kTv: return L"TV";
+    case kOva: return L"OVA";
+    case kMovie: return L"Movie";
+    case kSpecial: return L"Special";
+    case kOna: return L"ONA";
+    case kMusic: return L"Music";
+    default: return L"";
+  }
+}
+
+int TranslateType(const std::wstring& value) {
+  static const std::map<std::wstring, anime::SeriesType> types{
+    {L"tv", kTv},
+    {L"ova", kOva}, {L"oav", kOva},
+    {L"movie", kMovie}, {L"gekijouban", kMovie},
+    {L"special", kSpecial},
+    {L"ona", kOna},
+    {L"music", kMusic},
+  };
+
+  auto it = types.find(ToLower_Copy(value));
+  return it != types.end() ? it->second : anime::kUnknownType;
+}
+
+}  // namespace anime
@@ -27,7 +27,7 @@
 
 namespace sync {
 
-enum ServiceId {
+enum ServiceId : int {
   kAllServices = 0,
   kTaiga = 0,
   kFirstService = 1,
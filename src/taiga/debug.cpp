@@ -19,8 +19,12 @@
 #include "base/string.h"
 #include "library/anime_db.h"
 #include "taiga/debug.h"
+#ifndef TAIGA_HEADLESS
+#include "taiga/taiga.h"
+#include "track/recognition.h"
 #include "ui/dlg/dlg_main.h"
 #include "ui/dialog.h"
+#endif
 
 namespace debug {
 
@@ -33,6 +37,17 @@ void Tester::Start() {
 }
 
 void Tester::Stop(std::wstring str, bool display_result) {
+  const auto duration = Lap();
+
+  if (display_result) {
+    str = ToWstr(duration, 2) + L"ms | Text: [" + str + L"]";
+#ifndef TAIGA_HEADLESS
+    ui::DlgMain.SetText(str);
+#endif
+  }
+}
+
+float Tester::Lap() {
   using duration_t =
       std::chrono::duration<float, std::chrono::milliseconds::period>;
 
@@ -40,14 +55,12 @@ void Tester::Stop(std::wstring str, bool display_result) {
   const auto duration = std::chrono::duration_cast<duration_t>(now - t0_);
   t0_ = now;
 
-  if (display_result) {
-    str = ToWstr(duration.count(), 2) + L"ms | Text: [" + str + L"]";
-    ui::DlgMain.SetText(str);
-  }
+  return duration.count();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
+#ifndef TAIGA_HEADLESS
 void Print(std::wstring text) {
 #ifdef _DEBUG
   ::OutputDebugString(text.c_str());
@@ -57,6 +70,12 @@ void Print(std::wstring text) {
 }
 
 void Test() {
+  // Log identification stages since the last test, if they're being counted
+  if (Taiga.debug_mode) {
+    Meow.LogStageStats();
+    Meow.ResetStageStats();
+  }
+
   // Define variables
   std::wstring str;
 
@@ -76,5 +95,6 @@ void Test() {
   // Show result
   test.Stop(str, true);
 }
+#endif
 
 }  // namespace debug
@@ -20,6 +20,7 @@
 
 #include <chrono>
 #include <string>
+#include <vector>
 
 namespace debug {
 
@@ -31,6 +32,8 @@ public:
 
   void Start();
   void Stop(std::wstring str, bool display_result);
+  // Returns the milliseconds since the last call, and starts ticking again
+  float Lap();
 
 private:
   clock_t::time_point t0_;
@@ -39,4 +42,28 @@ private:
 void Print(std::wstring text);
 void Test();
 
+// Checks the bit-parallel string metrics against their reference versions,
+// runs the recognition engine and the feed aggregator against generated
+// databases of each size (checking that identification from multiple threads
+// gives the same results as a single thread), the relations parser against
+// the actual relations file, and stream detection against generated browser
+// pages, then saves the results to Path::TestBenchmark. Run with
+// "-benchmark", which does so in place of starting the application. Each
+// benchmark gets its own instances, so nothing that the application loads is
+// used or modified. Timings are only meaningful in a release build; debug
+// builds count allocations instead. The headless build (see project/cmake)
+// skips the feed aggregator and stream detection, which need the rest of the
+// application.
+struct BenchmarkOptions {
+  std::vector<size_t> title_counts{1000, 10000, 50000};
+  size_t file_count = 2000;
+  size_t feed_size = 100;  // items per feed, taken from the generated files
+  size_t filter_count = 500;  // limited to one anime each
+  size_t search_count = 200;
+  size_t page_count = 3000;
+  unsigned int seed = 1;
+};
+
+void BenchmarkRecognition(const BenchmarkOptions& options = {});
+
 }  // namespace debug
@@ -0,0 +1,822 @@
+/*
+** Taiga
+** Copyright (C) 2010-2018, Eren Okka
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iterator>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <thread>
+
+#ifdef _DEBUG
+#include <crtdbg.h>
+#endif
+
+#include "base/file.h"
+#include "base/json.h"
+#include "base/log.h"
+#include "base/string.h"
+#include "base/time.h"
+#include "library/anime.h"
+#include "library/anime_db.h"
+#include "library/anime_util.h"
+#include "sync/service.h"
+#include "taiga/debug.h"
+#include "taiga/path.h"
+#ifndef TAIGA_HEADLESS
+#include "track/feed.h"
+#include "track/media.h"
+#endif
+#include "track/recognition.h"
+
+namespace debug {
+
+static const wchar_t* const kRomajiWords[] = {
+  L"Aki", L"Boku", L"Densetsu", L"Fuyu", L"Gakuen", L"Hana", L"Haru",
+  L"Hime", L"Hoshi", L"Imouto", L"Isekai", L"Kaze", L"Kanojo", L"Kimi",
+  L"Kishi", L"Kokoro", L"Koi", L"Kyoukai", L"Mahou", L"Majo", L"Maou",
+  L"Monogatari", L"Natsu", L"no", L"Ookami", L"Ore", L"Ryuu", L"Sekai",
+  L"Senki", L"Sensei", L"Shoujo", L"Sora", L"Tenshi", L"Tensei", L"to",
+  L"Tsuki", L"wa", L"Yume", L"Yuusha", L"Zero",
+};
+
+static const wchar_t* const kEnglishWords[] = {
+  L"Academy", L"Attack", L"Chronicles", L"Dragon", L"Dream", L"Girl",
+  L"Heroes", L"Knight", L"Last", L"Legend", L"Magic", L"of", L"Online",
+  L"Spirit", L"Star", L"Story", L"Summer", L"Sword", L"The", L"World",
+};
+
+static const wchar_t* const kSequelSuffixes[] = {
+  L" 2nd Season", L" II", L": Part 2", L" S2", L" Second Season",
+};
+
+static const wchar_t* const kReleaseGroups[] = {
+  L"ASW", L"Commie", L"EMBER", L"Erai-raws", L"GJM", L"HorribleSubs",
+  L"Judas", L"SubsPlease",
+};
+
+static const wchar_t* const kVideoTerms[] = {
+  L"[1080p]", L"[720p]", L"[480p]", L"(1280x720 x264 AAC)",
+  L"[BD 1080p HEVC FLAC]", L"(WEB 1080p)",
+};
+
+static const wchar_t* const kExtensions[] = {
+  L"mkv", L"mp4",
+};
+
+static const int kEpisodeCounts[] = {
+  12, 13, 24, 26, anime::kUnknownEpisodeCount,
+};
+
+// Generated items, relations and titles that resemble the real ones, so that
+// results are comparable between releases without depending on user data.
+struct Dataset {
+  std::map<int, anime::Item> items;
+  std::string relations;
+  std::vector<std::wstring> filenames;
+  std::vector<std::wstring> feed_titles;
+  std::vector<std::wstring> queries;
+};
+
+static void GenerateDataset(size_t title_count,
+                            const BenchmarkOptions& options,
+                            Dataset& dataset) {
+  std::mt19937 random(options.seed);
+
+  auto chance = [&random](unsigned int percent) {
+    return random() % 100 < percent;
+  };
+  auto pick = [&random](const auto& values) {
+    return values[random() % std::size(values)];
+  };
+  auto words = [&](const auto& values, size_t min, size_t max) {
+    std::wstring str;
+    const size_t count = min + random() % (max - min + 1);
+    for (size_t i = 0; i < count; ++i) {
+      if (i)
+        str.push_back(L' ');
+      str += pick(values);
+    }
+    return str;
+  };
+
+  // Items that are followed by a sequel, where episodes past the end are
+  // redirected to the sequel
+  std::vector<int> prequel_ids;
+
+  for (int id = 1; dataset.items.size() < title_count; ) {
+    const auto title = words(kRomajiWords, 2, 5);
+    const auto english_title = chance(60) ?
+        words(kEnglishWords, 2, 4) : std::wstring();
+    const int type = chance(80) ? anime::kTv :
+                     chance(50) ? anime::kMovie : anime::kOva;
+    const int episode_count = type == anime::kMovie ? 1 : pick(kEpisodeCounts);
+    const int season_count = type == anime::kTv && episode_count > 0 &&
+                             chance(20) ? 2 + random() % 2 : 1;
+
+    for (int season = 0; season < season_count &&
+                         dataset.items.size() < title_count; ++season, ++id) {
+      const auto suffix = season ? std::wstring(pick(kSequelSuffixes)) : L"";
+      auto& item = dataset.items[id];
+      item.SetId(ToWstr(id), sync::kTaiga);
+      item.SetSource(sync::kTaiga);
+      item.SetType(type);
+      item.SetEpisodeCount(episode_count);
+      item.SetAiringStatus(anime::kFinishedAiring);
+      item.SetDateStart(Date(static_cast<unsigned short>(1990 + random() % 30),
+                             static_cast<unsigned short>(1 + random() % 12),
+                             1));
+      item.SetTitle(title + suffix);
+      if (!english_title.empty())
+        item.SetEnglishTitle(english_title + suffix);
+      if (chance(30))
+        item.SetSynonyms(std::vector<std::wstring>{words(kEnglishWords, 1, 3)});
+
+      if (season) {
+        const auto ids = ToWstr(id - 1) + L"|" + ToWstr(id - 1) + L"|" +
+                         ToWstr(id - 1);
+        const auto sequel_ids = ToWstr(id) + L"|" + ToWstr(id) + L"|" +
+                                ToWstr(id);
+        dataset.relations += WstrToStr(
+            L"- " + ids + L":" + ToWstr(episode_count + 1) + L"-" +
+            ToWstr(episode_count * 2) + L" -> " + sequel_ids + L":1-" +
+            ToWstr(episode_count) + L"\n");
+        prequel_ids.push_back(id - 1);
+      }
+    }
+  }
+
+  dataset.relations = "::rules\n" + dataset.relations;
+
+  std::vector<const anime::Item*> items;
+  items.reserve(dataset.items.size());
+  for (const auto& it : dataset.items) {
+    items.push_back(&it.second);
+  }
+
+  for (size_t i = 0; i < options.file_count; ++i) {
+    const auto& item = *items[random() % items.size()];
+    const int episode_count = std::max(item.GetEpisodeCount(), 1);
+
+    std::wstring title = item.GetTitle();
+    int episode = 1 + random() % episode_count;
+    if (!prequel_ids.empty() && chance(10)) {
+      // Continues numbering from the previous season
+      const auto& prequel = dataset.items[pick(prequel_ids)];
+      title = prequel.GetTitle();
+      episode = prequel.GetEpisodeCount() + 1 +
+                random() % prequel.GetEpisodeCount();
+    } else if (!item.GetEnglishTitle().empty() && chance(30)) {
+      title = item.GetEnglishTitle();
+    } else if (chance(5)) {
+      title = words(kRomajiWords, 2, 4);  // not in the database
+    }
+
+    const std::wstring group = pick(kReleaseGroups);
+    const auto number = PadChar(ToWstr(episode), L'0', 2);
+    std::wstring checksum;
+    for (int j = 0; j < 8; ++j) {
+      checksum.push_back(L"0123456789ABCDEF"[random() % 16]);
+    }
+
+    std::wstring filename;
+    switch (random() % 4) {
+      case 0:
+        filename = L"[" + group + L"] " + title + L" - " + number + L" " +
+                   pick(kVideoTerms);
+        break;
+      case 1:
+        filename = L"[" + group + L"] " + title + L" - " + number + L"v2 " +
+                   pick(kVideoTerms) + L"[" + checksum + L"]";
+        break;
+      case 2:
+        filename = title + L" E" + number + L" 1080p WEB x264-" + group;
+        ReplaceChar(filename, L' ', L'.');
+        break;
+      case 3:
+        filename = title + L" - Episode " + ToWstr(episode) + L" " +
+                   pick(kVideoTerms);
+        break;
+    }
+
+    dataset.feed_titles.push_back(filename);
+    dataset.filenames.push_back(filename + L"." + pick(kExtensions));
+  }
+
+  for (size_t i = 0; i < options.search_count; ++i) {
+    const auto& item = *items[random() % items.size()];
+    auto query = item.GetTitle();
+    switch (random() % 3) {
+      case 0:  // typo
+        query.erase(random() % query.size(), 1);
+        break;
+      case 1: {  // partial
+        const auto pos = query.find(L' ', query.size() / 2);
+        if (pos != query.npos)
+          query.resize(pos);
+        break;
+      }
+    }
+    dataset.queries.push_back(ToLower_Copy(query));
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Allocations can only be counted with the debug heap
+#ifdef _DEBUG
+static std::atomic<size_t> allocation_count{0};
+
+static int AllocationHook(int type, void*, size_t, int, long,
+                          const unsigned char*, int) {
+  if (type == _HOOK_ALLOC || type == _HOOK_REALLOC)
+    ++allocation_count;
+  return TRUE;
+}
+#endif
+
+struct Stage {
+  std::string name;
+  std::vector<float> latencies;  // in milliseconds
+  size_t allocations = 0;
+};
+
+template <typename Function>
+static void Measure(Stage& stage, size_t count, Function function) {
+  stage.latencies.reserve(stage.latencies.size() + count);
+
+#ifdef _DEBUG
+  const size_t allocations = allocation_count;
+#endif
+
+  Tester tester;
+  tester.Start();
+  for (size_t i = 0; i < count; ++i) {
+    function(i);
+    stage.latencies.push_back(tester.Lap());
+  }
+
+#ifdef _DEBUG
+  stage.allocations += allocation_count - allocations;
+#endif
+}
+
+static Json ReportStage(const Stage& stage) {
+  auto latencies = stage.latencies;
+  std::sort(latencies.begin(), latencies.end());
+
+  // Nearest-rank method
+  auto percentile = [&latencies](double p) {
+    if (latencies.empty())
+      return 0.0;
+    const auto rank = static_cast<size_t>(std::ceil(p * latencies.size()));
+    return static_cast<double>(latencies.at(std::max<size_t>(rank, 1) - 1));
+  };
+
+  const size_t calls = latencies.size();
+  const double total =
+      std::accumulate(latencies.begin(), latencies.end(), 0.0);
+  const double throughput = total > 0.0 ? calls * 1000.0 / total : 0.0;
+  const double p50 = percentile(0.50) * 1000.0;
+  const double p99 = percentile(0.99) * 1000.0;
+
+  Json json = {
+    {"stage", stage.name},
+    {"calls", calls},
+    {"total_ms", total},
+    {"calls_per_second", throughput},
+    {"p50_us", p50},
+    {"p99_us", p99},
+  };
+
+#ifdef _DEBUG
+  const double allocations =
+      calls ? static_cast<double>(stage.allocations) / calls : 0.0;
+  json["allocations_per_call"] = allocations;
+  LOGI(L"{}: {} calls, {:.1f}/s, p50 {:.1f}us, p99 {:.1f}us, {:.1f} allocs",
+       StrToWstr(stage.name), calls, throughput, p50, p99, allocations);
+#else
+  json["allocations_per_call"] = nullptr;
+  LOGI(L"{}: {} calls, {:.1f}/s, p50 {:.1f}us, p99 {:.1f}us",
+       StrToWstr(stage.name), calls, throughput, p50, p99);
+#endif
+
+  return json;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Identification from multiple threads on a shared engine must give the same
+// results as a single thread. Each thread identifies all of the episodes,
+// starting from a different one, and the cache starts empty for both passes
+// so that it is filled concurrently as well.
+static Json CheckConcurrentIdentification(
+    track::recognition::Engine& engine,
+    const std::vector<std::wstring>& titles,
+    const track::recognition::ParseOptions& parse_options,
+    const track::recognition::MatchOptions& match_options) {
+  constexpr size_t kMaxReportedMismatches = 10;
+  const size_t thread_count =
+      std::max<size_t>(4, std::thread::hardware_concurrency());
+
+  std::vector<anime::Episode> parsed_episodes(titles.size());
+  for (size_t i = 0; i < titles.size(); ++i) {
+    engine.Parse(titles[i], parse_options, parsed_episodes[i]);
+  }
+
+  auto expected_episodes = parsed_episodes;
+  engine.InvalidateCache();
+  for (auto& episode : expected_episodes) {
+    engine.Identify(episode, false, match_options);
+  }
+
+  std::vector<std::vector<anime::Episode>> thread_episodes(thread_count,
+                                                           parsed_episodes);
+  engine.InvalidateCache();
+  {
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < thread_count; ++t) {
+      threads.emplace_back([&, t]() {
+        auto& episodes = thread_episodes[t];
+        const size_t offset = t * episodes.size() / thread_count;
+        for (size_t i = 0; i < episodes.size(); ++i) {
+          auto& episode = episodes[(offset + i) % episodes.size()];
+          engine.Identify(episode, false, match_options);
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+
+  size_t mismatches = 0;
+  for (const auto& episodes : thread_episodes) {
+    for (size_t i = 0; i < episodes.size(); ++i) {
+      const auto& expected = expected_episodes[i];
+      const auto& episode = episodes[i];
+      if (episode.anime_id == expected.anime_id &&
+          episode.episode_number_range() == expected.episode_number_range())
+        continue;
+      if (++mismatches <= kMaxReportedMismatches)
+        LOGW(L"Concurrent identification mismatch: \"{}\" {} != {}",
+             titles[i], episode.anime_id, expected.anime_id);
+    }
+  }
+
+  LOGI(L"Identified {} titles from {} threads, found {} mismatches",
+       titles.size(), thread_count, mismatches);
+
+  return {
+    {"titles", titles.size()},
+    {"threads", thread_count},
+    {"mismatches", mismatches},
+  };
+}
+
+static Json BenchmarkDatabase(size_t title_count,
+                              const BenchmarkOptions& options) {
+  using namespace track::recognition;
+
+  constexpr size_t kInitializeCount = 3;
+  constexpr size_t kRelationsCount = 10;
+
+  Dataset dataset;
+  GenerateDataset(title_count, options, dataset);
+
+  LOGI(L"Benchmarking recognition with {} titles", dataset.items.size());
+
+  anime::Database database;
+  database.items = std::move(dataset.items);
+
+  std::vector<std::unique_ptr<Engine>> engines;
+  for (size_t i = 0; i < kInitializeCount; ++i) {
+    engines.push_back(std::make_unique<Engine>(database));
+  }
+  auto& engine = *engines.back();
+  engine.EnableStageStats(true);
+
+  std::vector<Stage> stages;
+
+  stages.push_back({"initialize_titles"});
+  Measure(stages.back(), kInitializeCount, [&](size_t i) {
+    engines[i]->InitializeTitles();
+  });
+
+  stages.push_back({"read_relations"});
+  Measure(stages.back(), kRelationsCount, [&](size_t) {
+    engine.ReadRelations(dataset.relations);
+  });
+
+  auto run_corpus = [&](const std::string& name,
+                        const std::vector<std::wstring>& titles,
+                        const ParseOptions& parse_options,
+                        const MatchOptions& match_options) {
+    std::vector<anime::Episode> episodes(titles.size());
+
+    stages.push_back({"parse_" + name});
+    Measure(stages.back(), titles.size(), [&](size_t i) {
+      engine.Parse(titles[i], parse_options, episodes[i]);
+    });
+
+    stages.push_back({"identify_" + name});
+    Measure(stages.back(), episodes.size(), [&](size_t i) {
+      engine.Identify(episodes[i], false, match_options);
+    });
+
+    return std::count_if(episodes.begin(), episodes.end(),
+        [](const anime::Episode& episode) {
+          return anime::IsValidId(episode.anime_id);
+        });
+  };
+
+  // Same options as the library scanner and the feed aggregator
+  ParseOptions parse_options;
+  MatchOptions match_options;
+  match_options.allow_sequels = true;
+  match_options.check_airing_date = true;
+  match_options.check_anime_type = true;
+  match_options.check_episode_number = true;
+
+  const auto identified_files = run_corpus(
+      "files", dataset.filenames, parse_options, match_options);
+  const auto identified_feed_titles = run_corpus(
+      "feed", dataset.feed_titles, parse_options, match_options);
+
+  // On an engine of its own, so that its stage stats only cover the stages
+  // above and below
+  Json concurrent_identification;
+  {
+    Engine concurrent_engine(database);
+    concurrent_engine.InitializeTitles();
+    concurrent_engine.ReadRelations(dataset.relations);
+    concurrent_identification = CheckConcurrentIdentification(
+        concurrent_engine, dataset.feed_titles, parse_options, match_options);
+  }
+
+#ifndef TAIGA_HEADLESS
+  // Whole feeds go through the aggregator, whose results are merged into the
+  // database and filtered. Cached results would skip the lookups, which is
+  // not what happens for new items. Its filters and archive are empty, so
+  // that filtering can be measured by itself below.
+  class Aggregator aggregator(database);
+  std::vector<Feed> feeds(options.feed_size ?
+      dataset.feed_titles.size() / options.feed_size : 0);
+  for (size_t i = 0; i < feeds.size() * options.feed_size; ++i) {
+    auto& feed = feeds[i / options.feed_size];
+    feed.items.emplace_back();
+    feed.items.back().title = dataset.feed_titles[i];
+  }
+  const auto unexamined_feeds = feeds;
+  engine.InvalidateCache();
+
+  stages.push_back({"examine_feed"});
+  Measure(stages.back(), feeds.size(), [&](size_t i) {
+    aggregator.ExamineData(feeds[i], engine);
+  });
+
+  // The same feeds again, as an automatic check sees them when there are no
+  // new items
+  for (size_t i = 0; i < feeds.size(); ++i)
+    feeds[i].items = unexamined_feeds[i].items;
+  stages.push_back({"examine_known_feed"});
+  Measure(stages.back(), feeds.size(), [&](size_t i) {
+    aggregator.ExamineData(feeds[i], engine);
+  });
+
+  // One fansub preference per anime, as users tend to have, in addition to
+  // the default filters. Anime in the feeds come first, so that some of the
+  // filters apply.
+  FeedFilterManager filter_manager(database);
+  filter_manager.AddPresets();
+  {
+    std::mt19937 random(options.seed);
+    std::vector<int> anime_ids;
+    for (const auto& feed : feeds) {
+      for (const auto& item : feed.items) {
+        if (anime::IsValidId(item.episode_data.anime_id))
+          anime_ids.push_back(item.episode_data.anime_id);
+      }
+    }
+    for (const auto& pair : database.items)
+      anime_ids.push_back(pair.first);
+    for (size_t i = 0; i < options.filter_count && i < anime_ids.size(); ++i) {
+      filter_manager.AddFilter(kFeedFilterActionPrefer, kFeedFilterMatchAll,
+                               kFeedFilterOptionDefault, true, L"[Fansub]");
+      filter_manager.filters.back().AddCondition(
+          kFeedFilterElement_Episode_Group, kFeedFilterOperator_Equals,
+          kReleaseGroups[random() % std::size(kReleaseGroups)]);
+      filter_manager.filters.back().anime_ids.push_back(anime_ids[i]);
+    }
+  }
+
+  stages.push_back({"filter_feed"});
+  Measure(stages.back(), feeds.size(), [&](size_t i) {
+    for (auto& item : feeds[i].items)
+      item.state = FeedItemState::Blank;
+    filter_manager.Filter(feeds[i], false);
+    filter_manager.Filter(feeds[i], true);
+  });
+#endif
+
+  stages.push_back({"search"});
+  Measure(stages.back(), dataset.queries.size(), [&](size_t i) {
+    std::vector<int> anime_ids;
+    engine.Search(dataset.queries[i], anime_ids);
+  });
+
+  const auto stage_stats = engine.GetStageStats();
+  engine.LogStageStats();
+
+  Json json = {
+    {"title_count", title_count},
+    {"file_count", dataset.filenames.size()},
+    {"identified_files", identified_files},
+    {"identified_feed_titles", identified_feed_titles},
+#ifndef TAIGA_HEADLESS
+    {"feed_size", options.feed_size},
+    {"filter_count", filter_manager.filters.size()},
+#endif
+    {"checks", {
+      {"concurrent_identification", concurrent_identification},
+    }},
+    {"stages", Json::array()},
+  };
+  for (const auto& stage : stages) {
+    json["stages"].push_back(ReportStage(stage));
+  }
+
+#ifndef TAIGA_HEADLESS
+  // What a feed check costs after the download, for one feed of new items
+  auto get_median = [&json](const std::string& name) {
+    for (const auto& stage : json["stages"]) {
+      if (JsonReadStr(stage, "stage") == name)
+        return JsonReadDouble(stage, "p50_us") / 1000.0;
+    }
+    return 0.0;
+  };
+  const double examine_feed = get_median("examine_feed");
+  const double filter_feed = get_median("filter_feed");
+  json["feed_check_ms"] = {
+    {"examine", examine_feed},
+    {"filter", filter_feed},
+    {"total", examine_feed + filter_feed},
+  };
+  LOGI(L"Feed of {} items with {} titles: {:.2f}ms to examine, {:.2f}ms to "
+       L"filter", options.feed_size, title_count, examine_feed, filter_feed);
+#endif
+
+  // Identification stages, across all of the above
+  json["identify_stages"] = Json::object();
+  for (size_t i = 0; i < stage_stats.size(); ++i) {
+    const auto& stats = stage_stats[i];
+    const auto name = Engine::GetStageName(static_cast<Engine::Stage>(i));
+    const auto time =
+        std::chrono::duration<double, std::milli>(stats.time).count();
+    json["identify_stages"][name] = {
+      {"calls", stats.calls},
+      {"hits", stats.hits},
+      {"candidates", stats.candidates},
+      {"time_ms", time},
+    };
+  }
+
+  return json;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TAIGA_HEADLESS
+// Browser pages, mostly ones that aren't streams, where "{}" is replaced with a
+// number so that each page is different
+static const std::pair<const wchar_t*, const wchar_t*> kBrowserPages[] = {
+  {L"https://www.google.com/search?q=anime+{}", L"anime {} - Google Search"},
+  {L"https://github.com/erengy/taiga/issues/{}",
+   L"Issue #{} \u00B7 erengy/taiga"},
+  {L"https://www.reddit.com/r/anime/comments/{}/", L"Discussion {} : anime"},
+  {L"https://en.wikipedia.org/wiki/Page_{}", L"Page {} - Wikipedia"},
+  {L"https://mail.google.com/mail/u/0/#inbox/{}", L"Inbox ({}) - Gmail"},
+  {L"chrome://newtab/", L"New Tab"},
+  {L"https://www.youtube.com/watch?v={}",
+   L"Video {} - YouTube - Audio playing"},
+  {L"https://www.crunchyroll.com/show/episode-{}-title-{}",
+   L"Show Episode {} - Watch on Crunchyroll"},
+  {L"https://www.funimation.com/shows/show/episode-{}/",
+   L"Watch Show Episode {} Anime Uncut on Funimation"},
+  {L"https://www.hidive.com/stream/show/s01e{}",
+   L"Stream Episode {} of Show on HIDIVE"},
+};
+
+static Json BenchmarkStreamDetection(const BenchmarkOptions& options) {
+  using namespace track::recognition;
+
+  std::mt19937 random(options.seed);
+
+  std::vector<std::pair<std::wstring, std::wstring>> pages;
+  for (size_t i = 0; i < options.page_count; ++i) {
+    const auto& page = kBrowserPages[random() % std::size(kBrowserPages)];
+    std::wstring url = page.first;
+    std::wstring title = page.second;
+    ReplaceString(url, L"{}", ToWstr(static_cast<int>(i)));
+    ReplaceString(title, L"{}", ToWstr(static_cast<int>(i)));
+    pages.emplace_back(url, title);
+  }
+
+  LOGI(L"Benchmarking stream detection with {} pages", pages.size());
+
+  std::vector<std::wstring> titles(pages.size());
+  std::vector<Stage> stages;
+
+  // Same steps as for each tab of a web browser
+  stages.push_back({"normalize_browser_title"});
+  Measure(stages.back(), pages.size(), [&](size_t i) {
+    titles[i] = pages[i].second;
+    NormalizeWebBrowserTitle(pages[i].first, titles[i]);
+  });
+
+  stages.push_back({"stream_title"});
+  Measure(stages.back(), pages.size(), [&](size_t i) {
+    GetTitleFromStreamingMediaProvider(pages[i].first, titles[i]);
+  });
+
+  const auto detected_streams = std::count_if(titles.begin(), titles.end(),
+      [](const std::wstring& title) { return !title.empty(); });
+
+  Json json = {
+    {"page_count", pages.size()},
+    {"detected_streams", detected_streams},
+    {"stages", Json::array()},
+  };
+  for (const auto& stage : stages) {
+    json["stages"].push_back(ReportStage(stage));
+  }
+
+  return json;
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+
+// The actual relations file, as it has many more rules and comments than the
+// generated ones. It is read by an engine of its own, so that neither Meow nor
+// the settings are affected.
+static Json BenchmarkRelations() {
+  using namespace track::recognition;
+
+  constexpr size_t kIterations = 100;
+
+  std::string document;
+  const auto path = taiga::GetPath(taiga::Path::DatabaseAnimeRelations);
+  if (!ReadFromFile(path, document)) {
+    LOGW(L"Could not read anime relations data.");
+    return nullptr;
+  }
+
+  LOGI(L"Benchmarking anime relations with {} bytes", document.size());
+
+  anime::Database database;
+  Engine engine(database);
+
+  std::vector<Stage> stages;
+  stages.push_back({"read_relations_file"});
+  Measure(stages.back(), kIterations, [&](size_t) {
+    engine.ReadRelations(document);
+  });
+
+  Json json = {
+    {"file_size", document.size()},
+    {"stages", Json::array()},
+  };
+  for (const auto& stage : stages) {
+    json["stages"].push_back(ReportStage(stage));
+  }
+
+  return json;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Bit-parallel string metrics must agree with their reference implementations.
+// Random strings with few distinct characters have more in common, and their
+// lengths span the one-word, two-word and fallback paths.
+static Json CheckStringMetrics(const BenchmarkOptions& options) {
+  constexpr size_t kPairCount = 20000;
+  constexpr size_t kMaxLength = 200;
+  constexpr size_t kMaxReportedMismatches = 10;
+  static const wchar_t kAlphabet[] = L"abcdeAB \u00E9\u3042\u30A2";
+
+  std::mt19937 random(options.seed);
+
+  auto generate = [&random](size_t alphabet_size) {
+    std::wstring str(random() % (kMaxLength + 1), L'\0');
+    for (auto& c : str)
+      c = kAlphabet[random() % alphabet_size];
+    return str;
+  };
+
+  // Levenshtein distance of two empty strings is NaN
+  auto is_same = [](double a, double b) {
+    return a == b || (std::isnan(a) && std::isnan(b));
+  };
+
+  size_t mismatches = 0;
+  auto check = [&](const wchar_t* name, bool same, const std::wstring& str1,
+                   const std::wstring& str2) {
+    if (same)
+      return;
+    if (++mismatches <= kMaxReportedMismatches)
+      LOGW(L"{} mismatch: \"{}\" \"{}\"", name, str1, str2);
+  };
+
+  for (size_t i = 0; i < kPairCount; ++i) {
+    const size_t alphabet_size = 1 + random() % (std::size(kAlphabet) - 1);
+    const auto str1 = generate(alphabet_size);
+    auto str2 = generate(alphabet_size);
+    if (random() % 2) {
+      // Similar strings, which are more likely to be compared in practice
+      str2 = str1;
+      for (size_t j = 0; j < 5 && !str2.empty(); ++j)
+        str2[random() % str2.size()] = kAlphabet[random() % alphabet_size];
+    }
+
+    check(L"LongestCommonSubsequenceLength",
+          LongestCommonSubsequenceLength(str1, str2) ==
+              LongestCommonSubsequenceLength_Reference(str1, str2),
+          str1, str2);
+    check(L"JaroWinklerDistance",
+          is_same(JaroWinklerDistance(str1, str2),
+                  JaroWinklerDistance_Reference(str1, str2)),
+          str1, str2);
+    check(L"LevenshteinDistance",
+          is_same(LevenshteinDistance(str1, str2),
+                  LevenshteinDistance_Reference(str1, str2)),
+          str1, str2);
+  }
+
+  LOGI(L"Checked string metrics on {} pairs, found {} mismatches", kPairCount,
+       mismatches);
+
+  return {
+    {"pairs", kPairCount},
+    {"mismatches", mismatches},
+  };
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void BenchmarkRecognition(const BenchmarkOptions& options) {
+#ifdef _DEBUG
+  LOGW(L"Timings of a debug build are not representative, only use them to "
+       L"count allocations.");
+  const auto previous_hook = _CrtSetAllocHook(AllocationHook);
+#endif
+
+  Json results = {
+#ifdef _DEBUG
+    {"build", "debug"},
+#else
+    {"build", "release"},
+#endif
+    {"checks", {
+      {"string_metrics", CheckStringMetrics(options)},
+    }},
+    {"recognition", Json::array()},
+    {"anime_relations", BenchmarkRelations()},
+#ifndef TAIGA_HEADLESS
+    {"stream_detection", BenchmarkStreamDetection(options)},
+#endif
+  };
+  for (const auto title_count : options.title_counts) {
+    results["recognition"].push_back(BenchmarkDatabase(title_count, options));
+  }
+
+#ifdef _DEBUG
+  _CrtSetAllocHook(previous_hook);
+#endif
+
+  const auto path = taiga::GetPath(taiga::Path::TestBenchmark);
+  if (SaveToFile(results.dump(2), path)) {
+    LOGI(L"Saved benchmark results to {}", path);
+  } else {
+    LOGW(L"Could not save benchmark results to {}", path);
+  }
+}
+
+}  // namespace debug
@@ -0,0 +1,103 @@
+/*
+** Taiga
+** Copyright (C) 2010-2018, Eren Okka
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Stands in for the parts of the application that the recognition core
+// depends on, so that the benchmark can be built and run on its own (see
+// project/cmake). Only the settings that the core reads are available, with
+// their default values, and paths are relative to the given data folder.
+
+#include "base/log.h"
+#include "base/string.h"
+#include "base/xml.h"
+#include "sync/service.h"
+#include "taiga/debug.h"
+#include "taiga/path.h"
+#include "taiga/settings.h"
+
+taiga::AppSettings Settings;
+
+namespace taiga {
+
+static std::wstring data_path = L"data/";
+
+void AppSettings::InitializeMap() {
+  if (!map_.empty())
+    return;
+
+  #define INITKEY(name, def, path) InitializeKey(name, def, path);
+  INITKEY(kRecognition_LookupParentDirectories, L"true",
+          L"recognition/general/lookup_parent_directories");
+  INITKEY(kRecognition_RelationsLastModified, nullptr,
+          L"recognition/general/relations_last_modified");
+  #undef INITKEY
+}
+
+void AppSettings::LoadDefaults() {
+  InitializeMap();
+
+  for (const auto& pair : map_) {
+    ReadValue(xml_node(), pair.first);
+  }
+}
+
+sync::ServiceId AppSettings::GetCurrentServiceId() const {
+  return sync::kMyAnimeList;
+}
+
+sync::ServiceId GetCurrentServiceId() {
+  return Settings.GetCurrentServiceId();
+}
+
+std::wstring GetPath(Path path) {
+  switch (path) {
+    default:
+    case Path::Data:
+      return data_path;
+    case Path::Database:
+      return data_path + L"db/";
+    case Path::DatabaseAnimeRelations:
+      return data_path + L"db/anime-relations.txt";
+    case Path::DatabaseRecognition:
+      return data_path + L"db/recognition.bin";
+    case Path::Test:
+      return data_path + L"test/";
+    case Path::TestBenchmark:
+      return data_path + L"test/benchmark.json";
+  }
+}
+
+}  // namespace taiga
+
+////////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char* argv[]) {
+  if (argc > 1) {
+    taiga::data_path = StrToWstr(argv[1]);
+    if (!taiga::data_path.empty() && taiga::data_path.back() != L'/')
+      taiga::data_path += L'/';
+  }
+
+  using monolog::Level;
+  monolog::log.enable_console_output(true);
+  monolog::log.set_level(Level::Informational);
+
+  Settings.LoadDefaults();
+  debug::BenchmarkRecognition();
+
+  return 0;
+}
@@ -196,6 +196,13 @@ void HttpManager::HandleError(HttpResponse& response, const string_t& error) {
     case kHttpServiceUpdateLibraryEntry:
       ServiceManager.HandleHttpError(client.response_, error);
       break;
+
+    case kHttpFeedCheck:
+    case kHttpFeedCheckAuto: {
+      bool automatic = client.mode() == kHttpFeedCheckAuto;
+      Aggregator.HandleFeedCheckError(response.parameter, automatic);
+      break;
+    }
   }
 
   FreeConnection(client.request_.url.host);
@@ -240,11 +247,9 @@ void HttpManager::HandleResponse(HttpResponse& response) {
 
     case kHttpFeedCheck:
     case kHttpFeedCheckAuto: {
-      Feed* feed = reinterpret_cast<Feed*>(response.parameter);
-      if (feed) {
-        bool automatic = client.mode() == kHttpFeedCheckAuto;
-        Aggregator.HandleFeedCheck(*feed, client.write_buffer_, automatic);
-      }
+      bool automatic = client.mode() == kHttpFeedCheckAuto;
+      Aggregator.HandleFeedCheck(response.parameter, client.write_buffer_,
+                                 automatic);
       break;
     }
     case kHttpFeedDownload: {
@@ -66,6 +66,8 @@ std::wstring GetPath(Path path) {
       return data_path + L"db\\anime.xml";
     case Path::DatabaseAnimeRelations:
       return data_path + L"db\\anime-relations.txt";
+    case Path::DatabaseRecognition:
+      return data_path + L"db\\recognition.bin";
     case Path::DatabaseImage:
       return data_path + L"db\\image\\";
     case Path::DatabaseSeason:
@@ -74,12 +76,16 @@ std::wstring GetPath(Path path) {
       return data_path + L"feed\\";
     case Path::FeedHistory:
       return data_path + L"feed\\history.xml";
+    case Path::FeedHistoryJournal:
+      return data_path + L"feed\\history.journal";
     case Path::Media:
       return data_path + L"players.anisthesia";
     case Path::Settings:
       return data_path + L"settings.xml";
     case Path::Test:
       return data_path + L"test\\";
+    case Path::TestBenchmark:
+      return data_path + L"test\\benchmark.json";
     case Path::TestRecognition:
       return data_path + L"test\\recognition.xml";
     case Path::Theme:
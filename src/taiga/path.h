@@ -21,7 +21,7 @@
 #include <string>
 
 namespace sync {
-enum ServiceId;
+enum ServiceId : int;
 }
 
 namespace taiga {
@@ -31,13 +31,16 @@ enum class Path {
   Database,
   DatabaseAnime,
   DatabaseAnimeRelations,
+  DatabaseRecognition,
   DatabaseImage,
   DatabaseSeason,
   Feed,
   FeedHistory,
+  FeedHistoryJournal,
   Media,
   Settings,
   Test,
+  TestBenchmark,
   TestRecognition,
   Theme,
   ThemeCurrent,
@@ -42,6 +42,7 @@
 #include "taiga/version.h"
 #include "track/media.h"
 #include "track/monitor.h"
+#include "track/recognition.h"
 #include "ui/dlg/dlg_anime_list.h"
 #include "ui/dlg/dlg_season.h"
 #include "ui/menu.h"
@@ -340,14 +341,19 @@ bool AppSettings::Load() {
   Aggregator.filter_manager.Import(node_filter, Aggregator.filter_manager.filters);
   if (Aggregator.filter_manager.filters.empty())
     Aggregator.filter_manager.AddPresets();
-  auto feed = Aggregator.GetFeed(FeedCategory::Link);
-  if (feed)
-    feed->link = GetWstr(kTorrent_Discovery_Source);
   Aggregator.LoadArchive();
 
   return result.status == pugi::status_ok;
 }
 
+void AppSettings::LoadDefaults() {
+  InitializeMap();
+
+  for (enum_t i = kAppSettingNameFirst; i < kAppSettingNameLast; ++i) {
+    ReadValue(xml_node(), i);
+  }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 bool AppSettings::Save() {
@@ -498,6 +504,10 @@ void AppSettings::ApplyChanges(const AppSettings previous) {
     ui::OnSettingsChange();
   }
 
+  // Library folders are used while identifying titles from parent directories
+  Meow.InvalidateCache();
+  Meow.UpdateParserOptions();
+
   bool enable_monitor = GetBool(kLibrary_WatchFolders);
   FolderMonitor.Enable(enable_monitor);
 
@@ -30,7 +30,7 @@ class xml_node;
 
 namespace sync {
 class Service;
-enum ServiceId;
+enum ServiceId : int;
 }
 
 namespace taiga {
@@ -189,6 +189,9 @@ extern const std::wstring kDefaultTorrentSource;
 class AppSettings : public base::Settings {
 public:
   bool Load();
+  // Default values only, without reading the settings file or applying them
+  // to anything else
+  void LoadDefaults();
   bool Save();
 
   void ApplyChanges(const AppSettings previous);
@@ -25,12 +25,14 @@
 #include "library/anime_db.h"
 #include "library/history.h"
 #include "taiga/announce.h"
+#include "taiga/debug.h"
 #include "taiga/dummy.h"
 #include "taiga/resource.h"
 #include "taiga/settings.h"
 #include "taiga/taiga.h"
 #include "taiga/version.h"
 #include "track/media.h"
+#include "track/recognition.h"
 #include "ui/dialog.h"
 #include "ui/menu.h"
 #include "ui/theme.h"
@@ -42,6 +44,7 @@ namespace taiga {
 
 App::App()
     : allow_multiple_instances(false),
+      benchmark_mode(false),
 #ifdef _DEBUG
       debug_mode(true)
 #else
@@ -70,10 +73,21 @@ BOOL App::InitInstance() {
   using monolog::Level;
   monolog::log.enable_console_output(false);
   monolog::log.set_path(path + TAIGA_APP_NAME L".log");
-  monolog::log.set_level(debug_mode ? Level::Debug : Level::Warning);
+  monolog::log.set_level(debug_mode ? Level::Debug :
+                         benchmark_mode ? Level::Informational :
+                                          Level::Warning);
   LOGI(L"Version {} ({})", StrToWstr(version.to_string()),
        GetFileLastModifiedDate(module_path));
 
+  // Run benchmarks and exit, without loading user data or creating any
+  // windows. This works alongside a running instance, and leaves its data
+  // alone, as nothing is saved except for the results.
+  if (benchmark_mode) {
+    Settings.LoadDefaults();
+    debug::BenchmarkRecognition();
+    return FALSE;
+  }
+
   // Check another instance
   if (!allow_multiple_instances) {
     if (CheckInstance(L"Taiga-33d5a63c-de90-432f-9a8b-f6f733dab258",
@@ -87,6 +101,10 @@ BOOL App::InitInstance() {
   InitCommonControls(ICC_STANDARD_CLASSES);
   OleInitialize(nullptr);
 
+  // Count identification stages in debug mode, to be logged on exit or from
+  // the debug button
+  Meow.EnableStageStats(debug_mode);
+
   // Load data
   LoadData();
 
@@ -127,6 +145,9 @@ void App::Uninitialize() {
   AnimeDatabase.SaveDatabase();
   Aggregator.SaveArchive();
 
+  if (debug_mode)
+    Meow.LogStageStats();
+
   // Exit
   PostQuitMessage();
 }
@@ -147,6 +168,9 @@ void App::ParseCommandLineArguments() {
     } else if (argument == L"-allowmultipleinstances") {
       allow_multiple_instances = true;
       LOGD(argument);
+    } else if (argument == L"-benchmark") {
+      benchmark_mode = true;
+      LOGD(argument);
     } else {
       LOGW(L"Invalid argument: {}", argument);
     }
@@ -41,6 +41,7 @@ public:
   void LoadData();
 
   bool allow_multiple_instances;
+  bool benchmark_mode;
   bool debug_mode;
   semaver::Version version;
 
@@ -132,12 +132,27 @@ Feed::Feed()
       source(FeedSource::Unknown) {
 }
 
-std::wstring Feed::GetDataPath() {
+// FNV-1a, as folder names have to stay the same between builds
+static UINT HashFeedAddress(const std::wstring& address) {
+  UINT hash = 2166136261u;
+  for (const auto c : address) {
+    hash ^= static_cast<UINT>(c);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+std::wstring Feed::GetDataPath() const {
   std::wstring path = taiga::GetPath(taiga::Path::Feed);
 
-  if (!link.empty()) {
-    Url url(link);
-    path += Base64Encode(url.host, true) + L"\\";
+  // Combined sources on the same host are told apart by their full address,
+  // which itself would be too long for a folder name
+  if (!address.empty()) {
+    Url url(address);
+    path += Base64Encode(url.host, true);
+    if (!single_source)
+      path += L"_" + ToWstr(HashFeedAddress(address));
+    path += L"\\";
   }
 
   return path;
@@ -215,6 +230,7 @@ void Feed::Load(const xml_document& document) {
     DecodeHtmlEntities(item.title);
     DecodeHtmlEntities(item.description);
 
+    item.feed_source = source;
     Aggregator.ParseFeedItem(source, item);
     Aggregator.CleanupDescription(item.description);
 
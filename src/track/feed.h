@@ -20,17 +20,28 @@
 
 #include <cstdint>
 #include <map>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "base/optional.h"
 #include "base/types.h"
 #include "library/anime_episode.h"
+#include "track/feed_archive.h"
 #include "track/feed_filter.h"
 
+namespace anime {
+class Database;
+}
 namespace pugi {
 class xml_document;
 }
+namespace track {
+namespace recognition {
+class Engine;
+}
+}
 
 enum class FeedItemState {
   Blank,
@@ -95,12 +106,14 @@ public:
   std::map<std::wstring, std::wstring> elements;
   std::wstring info_link;
   std::wstring magnet_link;
+  FeedSource feed_source = FeedSource::Unknown;
   FeedItemState state = FeedItemState::Blank;
   TorrentCategory torrent_category = TorrentCategory::Anime;
   Optional<size_t> seeders;
   Optional<size_t> leechers;
   Optional<size_t> downloads;
   uint64_t file_size = 0;
+  std::wstring data_path;  // of the source feed, where torrents are saved
 
   class EpisodeData : public anime::Episode {
   public:
@@ -133,13 +146,33 @@ public:
   Feed();
   ~Feed() {}
 
-  std::wstring GetDataPath();
+  std::wstring GetDataPath() const;
   bool Load();
   bool Load(const std::wstring& data);
 
   FeedCategory category;
   FeedSource source;
 
+  // Address of the source as configured, as opposed to the link of the
+  // channel. Its data is kept in a folder named after it, and the folder of a
+  // single source is named after its host alone, as it was before sources
+  // could be combined.
+  std::wstring address;
+  bool single_source = true;
+
+  // Items of the previous check, which are not parsed and identified again
+  // as long as the engine gives the same results
+  struct ExaminedItem {
+    std::wstring title;
+    FeedSource source = FeedSource::Unknown;
+    anime::Episode episode;
+  };
+  struct ExaminedItems {
+    std::unordered_map<std::wstring, ExaminedItem> items;
+    const track::recognition::Engine* engine = nullptr;
+    unsigned int generation = 0;
+  } examined;
+
 private:
   void Load(const pugi::xml_document& document);
 };
@@ -149,26 +182,34 @@ private:
 class Aggregator {
 public:
   Aggregator();
+  // Examined items are merged into, and filtered against, the given database
+  // instead of the one that is loaded
+  explicit Aggregator(anime::Database& database);
   ~Aggregator() {}
 
   Feed* GetFeed(FeedCategory category);
 
+  // Several sources can be separated by "|". They are checked concurrently,
+  // and their items are merged into the feed of the given category.
   bool CheckFeed(FeedCategory category, const std::wstring& source, bool automatic = false);
+  bool LoadFeed(FeedCategory category, const std::wstring& source);
   bool Download(FeedCategory category, const FeedItem* feed_item);
 
-  void HandleFeedCheck(Feed& feed, const std::string& data, bool automatic);
+  void HandleFeedCheck(LPARAM request_id, const std::string& data, bool automatic);
+  void HandleFeedCheckError(LPARAM request_id, bool automatic);
   void HandleFeedDownload(Feed& feed, const std::string& data);
   void HandleFeedDownloadError(Feed& feed);
   bool ValidateFeedDownload(const HttpRequest& http_request, HttpResponse& http_response);
 
   void FindFeedSource(Feed& feed) const;
   void ExamineData(Feed& feed);
+  void ExamineData(Feed& feed, track::recognition::Engine& engine);
   void ParseFeedItem(FeedSource source, FeedItem& feed_item);
   void CleanupDescription(std::wstring& description);
 
   size_t GetArchiveSize() const;
   bool LoadArchive();
-  bool SaveArchive() const;
+  bool SaveArchive();
   void AddToArchive(const std::wstring& file);
   void ClearArchive();
   bool SearchArchive(const std::wstring& file) const;
@@ -176,6 +217,17 @@ public:
   FeedFilterManager filter_manager;
 
 private:
+  struct FeedCheck {
+    std::vector<Feed*> sources;
+    std::map<LPARAM, Feed*> pending;  // by request ID
+    bool received = false;
+  };
+
+  std::vector<Feed*> GetSourceFeeds(FeedCategory category, const std::vector<std::wstring>& sources);
+  void MergeFeeds(Feed& feed, const std::vector<Feed*>& sources) const;
+  Feed* FindPendingFeed(LPARAM request_id);
+  void FinishFeedCheck(FeedCategory category, bool automatic);
+
   bool CompareFeedItems(const GenericFeedItem& item1, const GenericFeedItem& item2);
   FeedItem* FindFeedItemByLink(Feed& feed, const std::wstring& link);
   void HandleFeedDownloadOpen(FeedItem& feed_item, const std::wstring& file);
@@ -183,7 +235,11 @@ private:
 
   std::vector<std::wstring> download_queue_;
   std::vector<Feed> feeds_;
-  std::vector<std::wstring> file_archive_;
+  std::vector<std::unique_ptr<Feed>> source_feeds_;
+  std::map<FeedCategory, FeedCheck> feed_checks_;
+  LPARAM last_request_id_ = 0;
+  FeedArchive file_archive_;
+  anime::Database& database_;
 };
 
 extern class Aggregator Aggregator;
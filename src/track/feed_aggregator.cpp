@@ -18,11 +18,14 @@
 
 #include <algorithm>
 #include <regex>
+#include <string_view>
+#include <unordered_set>
 
 #include "base/file.h"
 #include "base/format.h"
 #include "base/html.h"
 #include "base/log.h"
+#include "base/parallel.h"
 #include "base/string.h"
 #include "base/time.h"
 #include "base/xml.h"
@@ -38,7 +41,11 @@
 
 class Aggregator Aggregator;
 
-Aggregator::Aggregator() {
+Aggregator::Aggregator() : Aggregator(AnimeDatabase) {
+}
+
+Aggregator::Aggregator(anime::Database& database)
+    : filter_manager(database), database_(database) {
   // Add torrent feed
   feeds_.resize(feeds_.size() + 1);
   feeds_.back().category = FeedCategory::Link;
@@ -52,26 +59,78 @@ Feed* Aggregator::GetFeed(FeedCategory category) {
   return nullptr;
 }
 
+static std::vector<std::wstring> SplitFeedSources(const std::wstring& source) {
+  std::vector<std::wstring> split_sources;
+  Split(source, L"|", split_sources);
+
+  std::vector<std::wstring> sources;
+  for (auto& address : split_sources) {
+    Trim(address);
+    if (!address.empty() &&
+        std::find(sources.begin(), sources.end(), address) == sources.end())
+      sources.push_back(address);
+  }
+
+  return sources;
+}
+
+std::vector<Feed*> Aggregator::GetSourceFeeds(
+    FeedCategory category, const std::vector<std::wstring>& sources) {
+  // Source feeds are reused rather than replaced, because pending requests
+  // refer to them.
+  std::vector<Feed*> feeds;
+  for (const auto& feed : source_feeds_) {
+    if (feeds.size() == sources.size())
+      break;
+    if (feed->category == category)
+      feeds.push_back(feed.get());
+  }
+  while (feeds.size() < sources.size()) {
+    source_feeds_.push_back(std::make_unique<Feed>());
+    source_feeds_.back()->category = category;
+    feeds.push_back(source_feeds_.back().get());
+  }
+
+  for (size_t i = 0; i < feeds.size(); ++i) {
+    feeds[i]->address = sources[i];
+    feeds[i]->single_source = sources.size() == 1;
+  }
+
+  return feeds;
+}
+
 bool Aggregator::CheckFeed(FeedCategory category, const std::wstring& source,
                            bool automatic) {
-  if (source.empty())
+  const auto sources = SplitFeedSources(source);
+  if (sources.empty())
     return false;
 
-  Feed& feed = *GetFeed(category);
+  auto& feed_check = feed_checks_[category];
+  feed_check.sources = GetSourceFeeds(category, sources);
+  feed_check.pending.clear();
+  feed_check.received = false;
 
-  feed.link = source;
+  std::vector<HttpRequest> http_requests;
+  std::vector<std::wstring> hosts;
 
-  HttpRequest http_request;
-  http_request.url = feed.link;
-  http_request.parameter = reinterpret_cast<LPARAM>(&feed);
-  http_request.header[L"Accept"] = L"application/rss+xml, */*";
-  http_request.header[L"Accept-Encoding"] = L"gzip";
+  // Each request gets a new ID, so that late responses to an earlier check
+  // are not mistaken for the current one
+  for (const auto feed : feed_check.sources) {
+    HttpRequest http_request;
+    http_request.url = feed->address;
+    http_request.parameter = ++last_request_id_;
+    http_request.header[L"Accept"] = L"application/rss+xml, */*";
+    http_request.header[L"Accept-Encoding"] = L"gzip";
+    http_requests.push_back(http_request);
+    hosts.push_back(http_request.url.host);
+    feed_check.pending[http_request.parameter] = feed;
+  }
 
-  switch (feed.category) {
+  switch (category) {
     case FeedCategory::Link:
       if (!automatic) {
         ui::ChangeStatusText(L"Checking new torrents via " +
-                             http_request.url.host + L"...");
+                             Join(hosts, L", ") + L"...");
       }
       ui::EnableDialogInput(ui::Dialog::Torrents, false);
       break;
@@ -80,56 +139,215 @@ bool Aggregator::CheckFeed(FeedCategory category, const std::wstring& source,
   auto client_mode = automatic ?
       taiga::kHttpFeedCheckAuto : taiga::kHttpFeedCheck;
 
-  ConnectionManager.MakeRequest(http_request, client_mode);
+  // All requests are queued at once, so that sources are checked
+  // concurrently.
+  for (auto& http_request : http_requests)
+    ConnectionManager.MakeRequest(http_request, client_mode);
 
   return true;
 }
 
+bool Aggregator::LoadFeed(FeedCategory category, const std::wstring& source) {
+  const auto sources = GetSourceFeeds(category, SplitFeedSources(source));
+
+  bool loaded = false;
+  for (const auto feed : sources) {
+    if (feed->Load())
+      loaded = true;
+  }
+
+  Feed& feed = *GetFeed(category);
+  MergeFeeds(feed, sources);
+  ExamineData(feed);
+
+  return loaded;
+}
+
+void Aggregator::MergeFeeds(Feed& feed,
+                            const std::vector<Feed*>& sources) const {
+  feed.items.clear();
+
+  if (!sources.empty()) {
+    feed.title = sources.front()->title;
+    feed.link = sources.front()->link;
+    feed.description = sources.front()->description;
+  }
+  feed.source = sources.size() == 1 ? sources.front()->source :
+                                      FeedSource::Unknown;
+
+  size_t item_count = 0;
+  for (const auto source : sources)
+    item_count += source->items.size();
+  // Views of merged items must stay valid
+  feed.items.reserve(item_count);
+
+  // An item is skipped if it is equal to an item from a previous source. This
+  // is the same as comparing it with FeedItem::operator==, except that each
+  // identifier is looked up in a hash set.
+  std::unordered_set<std::wstring_view> guids;
+  std::unordered_set<std::wstring_view> links;
+  std::unordered_set<std::wstring_view> titles;
+
+  for (const auto source : sources) {
+    const size_t first_item = feed.items.size();
+    const auto data_path = source->GetDataPath();
+
+    for (const auto& item : source->items) {
+      if (item.permalink && !item.guid.empty() && guids.count(item.guid))
+        continue;
+      if (!item.link.empty() && links.count(item.link))
+        continue;
+      if (!item.title.empty() && titles.count(item.title))
+        continue;
+      feed.items.push_back(item);
+      feed.items.back().data_path = data_path;
+    }
+
+    // Items from the same source are not compared with each other
+    for (size_t i = first_item; i < feed.items.size(); ++i) {
+      const auto& item = feed.items[i];
+      if (item.permalink && !item.guid.empty())
+        guids.insert(item.guid);
+      if (!item.link.empty())
+        links.insert(item.link);
+      if (!item.title.empty())
+        titles.insert(item.title);
+    }
+  }
+}
+
+static std::wstring PreprocessTitle(FeedSource source,
+                                    const std::wstring& title) {
+  switch (source) {
+    case FeedSource::AnimeBytes: {
+      // Anitomy cannot parse AnimeBytes' titles as is. To avoid writing
+      // another parser, we pre-process (i.e. hack) the title instead:
+      // 1. Ignore anime type and year (because we normally assume that they
+      //    are only used to differentiate)
+      // 2. Insert a pseudo-keyword (to make Anitomy stop there while parsing
+      //    anime title)
+      std::wsmatch matches;
+      static const std::wregex pattern{L"(.+) - .+ \\[\\d{4}\\] :: (.+)"};
+      if (std::regex_match(title, matches, pattern))
+        return matches[1].str() + L" [REMASTER] " + matches[2].str();
+      break;
+    }
+  }
+
+  return title;
+}
+
 void Aggregator::ExamineData(Feed& feed) {
-  for (auto& feed_item : feed.items) {
-    auto title = feed_item.title;
-    switch (feed.source) {
-      case FeedSource::AnimeBytes: {
-        // Anitomy cannot parse AnimeBytes' titles as is. To avoid writing
-        // another parser, we pre-process (i.e. hack) the title instead:
-        // 1. Ignore anime type and year (because we normally assume that they
-        //    are only used to differentiate)
-        // 2. Insert a pseudo-keyword (to make Anitomy stop there while parsing
-        //    anime title)
-        std::wsmatch matches;
-        static const std::wregex pattern{L"(.+) - .+ \\[\\d{4}\\] :: (.+)"};
-        if (std::regex_match(title, matches, pattern))
-          title = matches[1].str() + L" [REMASTER] " + matches[2].str();
-        break;
-      }
+  ExamineData(feed, Meow);
+}
+
+static const std::wstring& GetExaminedItemKey(const FeedItem& feed_item) {
+  if (feed_item.permalink && !feed_item.guid.empty())
+    return feed_item.guid;
+  if (!feed_item.link.empty())
+    return feed_item.link;
+  return feed_item.title;
+}
+
+void Aggregator::ExamineData(Feed& feed,
+                             track::recognition::Engine& engine) {
+  // Items that were examined in the previous check keep their results, unless
+  // the engine may identify them differently now. The generation also changes
+  // with the date in Japan, which airing dates are checked against, so that
+  // neither these results nor the ones cached by the engine carry over to the
+  // next day.
+  auto& examined = feed.examined;
+  const auto generation = engine.GetGeneration();
+  if (examined.engine != &engine || examined.generation != generation) {
+    examined.items.clear();
+    examined.engine = &engine;
+    examined.generation = generation;
+  }
+
+  std::vector<size_t> new_items;
+  for (size_t i = 0; i < feed.items.size(); ++i) {
+    auto& feed_item = feed.items[i];
+    auto it = examined.items.find(GetExaminedItemKey(feed_item));
+    if (it != examined.items.end() &&
+        it->second.title == feed_item.title &&
+        it->second.source == feed_item.feed_source) {
+      static_cast<anime::Episode&>(feed_item.episode_data) = it->second.episode;
+    } else {
+      new_items.push_back(i);
     }
+  }
 
-    auto& episode_data = feed_item.episode_data;
-
-    // Examine title and compare with anime list items
-    static track::recognition::ParseOptions parse_options;
-    parse_options.parse_path = false;
-    parse_options.streaming_media = false;
-    Meow.Parse(title, parse_options, episode_data);
-    static track::recognition::MatchOptions match_options;
-    match_options.allow_sequels = true;
-    match_options.check_airing_date = true;
-    match_options.check_anime_type = true;
-    match_options.check_episode_number = true;
-    match_options.streaming_media = false;
-    Meow.Identify(episode_data, false, match_options);
-
-    // Update last aired episode number
-    if (anime::IsValidId(episode_data.anime_id)) {
-      auto anime_item = AnimeDatabase.FindItem(episode_data.anime_id);
-      if (anime_item) {
-        int episode_number = anime::GetEpisodeHigh(episode_data);
-        anime_item->SetLastAiredEpisodeNumber(episode_number);
+  // Pre-process and parse titles on worker threads. Each item only touches
+  // its own episode, so this is the same as doing it one item at a time.
+  static track::recognition::ParseOptions parse_options;
+  parse_options.parse_path = false;
+  parse_options.streaming_media = false;
+  std::vector<anime::Episode> episodes(new_items.size());
+  base::ParallelFor(new_items.size(), [&](size_t i) {
+    const auto& feed_item = feed.items[new_items[i]];
+    const auto title = PreprocessTitle(feed_item.feed_source, feed_item.title);
+    engine.Parse(title, parse_options, episodes[i]);
+  });
+
+  // Episode numbers of batch releases without one are taken from the
+  // database, which changes without affecting the generation.
+  std::vector<char> reusable(feed.items.size(), true);
+  for (size_t i = 0; i < new_items.size(); ++i) {
+    const auto& episode = episodes[i];
+    reusable[new_items[i]] =
+        !episode.elements().empty(anitomy::kElementEpisodeNumber) ||
+        !episode.elements().empty(anitomy::kElementVolumeNumber) ||
+        !episode.file_extension().empty();
+  }
+
+  // Items are finished in order, because updating the database affects the
+  // post-processing of the items that follow.
+  size_t finished_items = 0;
+  auto finish_items = [&](size_t end) {
+    for ( ; finished_items < end; ++finished_items) {
+      auto& feed_item = feed.items.at(finished_items);
+      auto& episode_data = feed_item.episode_data;
+
+      // Update last aired episode number
+      if (anime::IsValidId(episode_data.anime_id)) {
+        auto anime_item = database_.FindItem(episode_data.anime_id);
+        if (anime_item) {
+          int episode_number = anime::GetEpisodeHigh(episode_data);
+          anime_item->SetLastAiredEpisodeNumber(episode_number);
+        }
       }
+
+      // Categorize
+      feed_item.torrent_category = GetTorrentCategory(feed_item);
     }
+  };
 
-    // Categorize
-    feed_item.torrent_category = GetTorrentCategory(feed_item);
+  // Examine titles and compare with anime list items. Lookups run on worker
+  // threads as well, while the results are merged in order on this thread,
+  // because they modify the database.
+  static track::recognition::MatchOptions match_options;
+  match_options.allow_sequels = true;
+  match_options.check_airing_date = true;
+  match_options.check_anime_type = true;
+  match_options.check_episode_number = true;
+  match_options.streaming_media = false;
+  engine.IdentifyBatch(episodes, match_options, [&](size_t i) {
+    finish_items(new_items.at(i));
+    auto& episode_data = feed.items.at(new_items.at(i)).episode_data;
+    static_cast<anime::Episode&>(episode_data) = std::move(episodes.at(i));
+    finish_items(new_items.at(i) + 1);
+    return false;
+  });
+  finish_items(feed.items.size());
+
+  // Only the items of this check are kept for the next one
+  examined.items.clear();
+  for (size_t i = 0; i < feed.items.size(); ++i) {
+    if (!reusable[i])
+      continue;
+    const auto& feed_item = feed.items[i];
+    examined.items[GetExaminedItemKey(feed_item)] = {
+        feed_item.title, feed_item.feed_source, feed_item.episode_data};
   }
 
   filter_manager.MarkNewEpisodes(feed);
@@ -138,7 +356,7 @@ void Aggregator::ExamineData(Feed& feed) {
   filter_manager.Filter(feed, false);
   filter_manager.Filter(feed, true);
   // Archived items must be discarded after other filters are processed.
-  filter_manager.FilterArchived(feed);
+  filter_manager.FilterArchived(feed, file_archive_);
 
   // Sort items
   std::stable_sort(feed.items.begin(), feed.items.end());
@@ -227,12 +445,56 @@ FeedItem* Aggregator::FindFeedItemByLink(Feed& feed, const std::wstring& link) {
   return nullptr;
 }
 
-void Aggregator::HandleFeedCheck(Feed& feed, const std::string& data,
+Feed* Aggregator::FindPendingFeed(LPARAM request_id) {
+  for (const auto& pair : feed_checks_) {
+    auto it = pair.second.pending.find(request_id);
+    if (it != pair.second.pending.end())
+      return it->second;
+  }
+
+  return nullptr;
+}
+
+void Aggregator::HandleFeedCheck(LPARAM request_id, const std::string& data,
                                  bool automatic) {
+  auto feed_ptr = FindPendingFeed(request_id);
+  if (!feed_ptr) {
+    LOGD(L"Ignoring response to an earlier feed check.");
+    return;
+  }
+  Feed& feed = *feed_ptr;
+
   std::wstring file = feed.GetDataPath() + L"feed.xml";
   SaveToFile(data, file);
 
   feed.Load(StrToWstr(data));
+
+  // Results are merged once every source has been checked
+  auto& feed_check = feed_checks_[feed.category];
+  feed_check.pending.erase(request_id);
+  feed_check.received = true;
+  if (feed_check.pending.empty())
+    FinishFeedCheck(feed.category, automatic);
+}
+
+void Aggregator::HandleFeedCheckError(LPARAM request_id, bool automatic) {
+  auto feed = FindPendingFeed(request_id);
+  if (!feed)
+    return;
+
+  feed->items.clear();
+
+  // Previous results are kept if none of the sources could be checked
+  auto& feed_check = feed_checks_[feed->category];
+  feed_check.pending.erase(request_id);
+  if (feed_check.pending.empty() && feed_check.received)
+    FinishFeedCheck(feed->category, automatic);
+}
+
+void Aggregator::FinishFeedCheck(FeedCategory category, bool automatic) {
+  Feed& feed = *GetFeed(category);
+
+  MergeFeeds(feed, feed_checks_[category].sources);
   ExamineData(feed);
   download_queue_.clear();
 
@@ -274,7 +536,8 @@ void Aggregator::HandleFeedDownload(Feed& feed, const std::string& data) {
   if (!data.empty()) {
     file = feed_item->title;
     ValidateFileName(file);
-    file = feed.GetDataPath() + file + L".torrent";
+    // In the folder of the source that the item came from
+    file = feed_item->data_path + file + L".torrent";
 
     SaveToFile(data, file);
 
@@ -323,7 +586,7 @@ std::wstring GetTorrentDownloadPath(const FeedItem::EpisodeData& episode_data) {
   std::wstring path;
 
   // Use anime folder as the download folder
-  const auto anime_item = AnimeDatabase.FindItem(episode_data.anime_id);
+  const auto anime_item = database_.FindItem(episode_data.anime_id);
   if (anime_item) {
     const auto anime_folder = anime_item->GetFolder();
     if (!anime_folder.empty() && FolderExists(anime_folder))
@@ -556,54 +819,21 @@ size_t Aggregator::GetArchiveSize() const {
 }
 
 bool Aggregator::LoadArchive() {
-  xml_document document;
-  std::wstring path = taiga::GetPath(taiga::Path::FeedHistory);
-  xml_parse_result parse_result = document.load_file(path.c_str());
-
-  if (parse_result.status != pugi::status_ok)
-    return false;
-
-  // Read discarded
-  file_archive_.clear();
-  xml_node archive_node = document.child(L"archive");
-  foreach_xmlnode_(node, archive_node, L"item") {
-    file_archive_.push_back(node.attribute(L"title").value());
-  }
-
-  return true;
+  return file_archive_.Load();
 }
 
-bool Aggregator::SaveArchive() const {
-  xml_document document;
-  xml_node archive_node = document.append_child(L"archive");
-
-  size_t max_count = Settings.GetInt(taiga::kTorrent_Filter_ArchiveMaxCount);
-
-  if (max_count > 0) {
-    size_t length = file_archive_.size();
-    size_t i = 0;
-    if (length > max_count)
-      i = length - max_count;
-    for ( ; i < file_archive_.size(); i++) {
-      xml_node xml_item = archive_node.append_child(L"item");
-      xml_item.append_attribute(L"title") = file_archive_[i].c_str();
-    }
-  }
-
-  std::wstring path = taiga::GetPath(taiga::Path::FeedHistory);
-  return XmlWriteDocumentToFile(document, path);
+bool Aggregator::SaveArchive() {
+  return file_archive_.Save();
 }
 
 void Aggregator::AddToArchive(const std::wstring& file) {
-  if (!SearchArchive(file))
-    file_archive_.push_back(file);
+  file_archive_.Add(file);
 }
 
 void Aggregator::ClearArchive() {
-  file_archive_.clear();
+  file_archive_.Clear();
 }
 
 bool Aggregator::SearchArchive(const std::wstring& file) const {
-  auto it = std::find(file_archive_.begin(), file_archive_.end(), file);
-  return it != file_archive_.end();
+  return file_archive_.Contains(file);
 }
@@ -0,0 +1,220 @@
+/*
+** Taiga
+** Copyright (C) 2010-2018, Eren Okka
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+
+#include "base/file.h"
+#include "base/log.h"
+#include "base/string.h"
+#include "base/xml.h"
+#include "taiga/path.h"
+#include "taiga/settings.h"
+#include "track/feed_archive.h"
+
+// Journals shorter than this are not worth merging, even for small archives
+constexpr size_t kMinJournalCount = 100;
+
+// 0 means that the archive is not limited while the application is running,
+// but it is not saved either.
+static size_t GetMaxCount() {
+  const int max_count = Settings.GetInt(taiga::kTorrent_Filter_ArchiveMaxCount);
+  return max_count > 0 ? static_cast<size_t>(max_count) : 0;
+}
+
+// Each title is on its own line in the journal
+static std::string EscapeJournalLine(const std::wstring& title) {
+  std::string line;
+  for (const auto c : WstrToStr(title)) {
+    switch (c) {
+      case '\\': line += "\\\\"; break;
+      case '\n': line += "\\n"; break;
+      case '\r': line += "\\r"; break;
+      default: line += c; break;
+    }
+  }
+  return line;
+}
+
+static std::wstring UnescapeJournalLine(const std::string& line) {
+  std::string str;
+  for (size_t i = 0; i < line.size(); ++i) {
+    if (line[i] == '\\' && i + 1 < line.size()) {
+      switch (line[++i]) {
+        case 'n': str += '\n'; break;
+        case 'r': str += '\r'; break;
+        default: str += line[i]; break;
+      }
+    } else {
+      str += line[i];
+    }
+  }
+  return StrToWstr(str);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool FeedArchive::Load() {
+  Clear();
+  compact_pending_ = false;
+
+  const size_t max_count = GetMaxCount();
+
+  xml_document document;
+  const auto path = taiga::GetPath(taiga::Path::FeedHistory);
+  const xml_parse_result parse_result = document.load_file(path.c_str());
+  const bool loaded = parse_result.status == pugi::status_ok;
+
+  if (loaded) {
+    xml_node archive_node = document.child(L"archive");
+    foreach_xmlnode_(node, archive_node, L"item") {
+      Insert(node.attribute(L"title").value(), max_count);
+    }
+  }
+
+  // Titles that were added after the archive was saved. The last line is
+  // incomplete if we were interrupted while appending it, in which case we
+  // have to rewrite the files before appending anything else to it.
+  std::string journal;
+  const auto journal_path = taiga::GetPath(taiga::Path::FeedHistoryJournal);
+  if (ReadFromFile(journal_path, journal)) {
+    for (size_t pos = 0, end; (end = journal.find('\n', pos)) != journal.npos;
+         pos = end + 1) {
+      Insert(UnescapeJournalLine(journal.substr(pos, end - pos)), max_count);
+      ++journal_count_;
+    }
+    if (!journal.empty() && journal.back() != '\n')
+      compact_pending_ = true;
+    LOGD(L"Read {} titles from the archive journal.", journal_count_);
+  }
+
+  unsaved_count_ = 0;
+
+  return loaded || journal_count_ > 0;
+}
+
+bool FeedArchive::Save() {
+  const size_t max_count = GetMaxCount();
+  Trim(max_count);
+
+  if (!max_count || compact_pending_ ||
+      journal_count_ + unsaved_count_ > std::max(max_count, kMinJournalCount))
+    return Compact(max_count);
+
+  if (!unsaved_count_)
+    return true;
+
+  std::string lines;
+  for (auto it = titles_.end() - unsaved_count_; it != titles_.end(); ++it) {
+    lines += EscapeJournalLine(*it);
+    lines += '\n';
+  }
+
+  const auto journal_path = taiga::GetPath(taiga::Path::FeedHistoryJournal);
+  if (!AppendToFile(lines, journal_path)) {
+    // Part of the lines may have been written nonetheless
+    compact_pending_ = true;
+    return Compact(max_count);
+  }
+
+  journal_count_ += unsaved_count_;
+  unsaved_count_ = 0;
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void FeedArchive::Add(const std::wstring& title) {
+  if (Insert(title, GetMaxCount()))
+    ++unsaved_count_;
+}
+
+void FeedArchive::Clear() {
+  index_.clear();
+  titles_.clear();
+  unsaved_count_ = 0;
+  journal_count_ = 0;
+  compact_pending_ = true;
+}
+
+bool FeedArchive::Contains(const std::wstring& title) const {
+  return index_.count(title) > 0;
+}
+
+size_t FeedArchive::size() const {
+  return titles_.size();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool FeedArchive::Insert(const std::wstring& title, size_t max_count) {
+  if (Contains(title))
+    return false;
+
+  // References to elements of a deque stay valid when elements are added to
+  // or removed from either end, so the index can refer to them.
+  titles_.push_back(title);
+  index_.insert(titles_.back());
+
+  Trim(max_count);
+
+  return true;
+}
+
+void FeedArchive::Trim(size_t max_count) {
+  if (!max_count)
+    return;
+
+  while (titles_.size() > max_count) {
+    index_.erase(titles_.front());
+    titles_.pop_front();
+  }
+
+  // Replaying the journal would not drop the same titles if some of the ones
+  // that caused them to be dropped were never written to it.
+  if (unsaved_count_ > titles_.size()) {
+    unsaved_count_ = titles_.size();
+    compact_pending_ = true;
+  }
+}
+
+bool FeedArchive::Compact(size_t max_count) {
+  xml_document document;
+  xml_node archive_node = document.append_child(L"archive");
+
+  if (max_count > 0) {
+    for (const auto& title : titles_) {
+      xml_node xml_item = archive_node.append_child(L"item");
+      xml_item.append_attribute(L"title") = title.c_str();
+    }
+  }
+
+  const auto path = taiga::GetPath(taiga::Path::FeedHistory);
+  if (!XmlWriteDocumentToFile(document, path))
+    return false;
+
+  const auto journal_path = taiga::GetPath(taiga::Path::FeedHistoryJournal);
+  if (FileExists(journal_path))
+    ::DeleteFile(GetExtendedLengthPath(journal_path).c_str());
+
+  unsaved_count_ = 0;
+  journal_count_ = 0;
+  compact_pending_ = false;
+
+  return true;
+}
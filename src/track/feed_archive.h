@@ -0,0 +1,59 @@
+/*
+** Taiga
+** Copyright (C) 2010-2018, Eren Okka
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+
+// Titles of feed items that were downloaded or discarded, so that they can be
+// discarded again when they show up in a feed. Titles are looked up in a hash
+// set, and kept in the order they were added, so that the oldest ones can be
+// dropped once the archive is full.
+//
+// The archive is saved to Path::FeedHistory, and titles that are added after
+// that are appended to Path::FeedHistoryJournal. Once the journal gets as long
+// as the archive, both are merged into Path::FeedHistory again.
+class FeedArchive {
+public:
+  FeedArchive() {}
+  FeedArchive(const FeedArchive&) = delete;
+  FeedArchive& operator=(const FeedArchive&) = delete;
+  ~FeedArchive() {}
+
+  bool Load();
+  bool Save();
+
+  void Add(const std::wstring& title);
+  void Clear();
+  bool Contains(const std::wstring& title) const;
+  size_t size() const;
+
+private:
+  bool Insert(const std::wstring& title, size_t max_count);
+  void Trim(size_t max_count);
+  bool Compact(size_t max_count);
+
+  std::deque<std::wstring> titles_;  // oldest first
+  std::unordered_set<std::wstring_view> index_;  // views of titles_
+  size_t unsaved_count_ = 0;  // at the end of titles_
+  size_t journal_count_ = 0;  // titles in the journal
+  bool compact_pending_ = false;
+};
@@ -16,6 +16,10 @@
 ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <iterator>
+#include <unordered_map>
+
 #include "base/file.h"
 #include "base/foreach.h"
 #include "base/log.h"
@@ -30,14 +34,163 @@
 #include "track/feed.h"
 #include "track/feed_filter.h"
 
-bool EvaluateCondition(const FeedFilterCondition& condition,
-                       const FeedItem& item) {
-  bool is_numeric = false;
+FeedFilterContext::FeedFilterContext(const FeedItem& item,
+                                     anime::Database& database)
+    : item(item),
+      anime_item(database.FindItem(item.episode_data.anime_id)),
+      episode_number(anime::GetEpisodeHigh(item.episode_data)),
+      video_resolution(anime::TranslateResolution(
+          item.episode_data.video_resolution())) {
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Must agree with IsEqual, which compares characters with tolower.
+static size_t HashIgnoringCase(const std::wstring& str) {
+  size_t hash = 2166136261u;
+  for (const auto c : str) {
+    hash ^= static_cast<size_t>(tolower(c));
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+FeedFilterPass::FeedFilterPass(const Feed& feed, anime::Database& database)
+    : feed_(feed) {
+  contexts.reserve(feed.items.size());
+  for (const auto& item : feed.items)
+    contexts.emplace_back(item, database);
+}
+
+const std::vector<size_t>& FeedFilterPass::FindSiblings(size_t index,
+                                                        unsigned int mask) {
+  auto& buckets = siblings_[mask];
+
+  if (buckets.empty()) {
+    for (size_t i = 0; i < feed_.items.size(); ++i)
+      buckets[GetSiblingKey(i, mask)].push_back(i);
+  }
+
+  return buckets[GetSiblingKey(index, mask)];
+}
+
+// Items with different keys can't pass the checks of ApplyPreferenceFilter,
+// while the same key doesn't mean that they will.
+size_t FeedFilterPass::GetSiblingKey(size_t index, unsigned int mask) const {
+  const auto& episode = feed_.items.at(index).episode_data;
+
+  auto is_ignored = [&mask](FeedFilterElement element) {
+    return (mask & (1u << element)) != 0;
+  };
+
+  size_t key = 0;
+  auto combine = [&key](size_t value) {
+    key ^= value + 0x9e3779b9 + (key << 6) + (key >> 2);
+  };
+
+  // Items are compared by anime ID if either of them has one, and by title
+  // otherwise. If IDs are ignored, items with and without IDs can match.
+  if (!is_ignored(kFeedFilterElement_Meta_Id)) {
+    const bool is_valid_id = anime::IsValidId(episode.anime_id);
+    combine(is_valid_id);
+    if (is_valid_id) {
+      combine(static_cast<size_t>(episode.anime_id));
+    } else if (!is_ignored(kFeedFilterElement_Episode_Title)) {
+      combine(HashIgnoringCase(episode.anime_title()));
+    }
+  }
+
+  if (!is_ignored(kFeedFilterElement_Episode_Number)) {
+    const auto range = episode.episode_number_range();
+    combine(static_cast<size_t>(range.first));
+    combine(static_cast<size_t>(range.second));
+  }
+
+  if (!is_ignored(kFeedFilterElement_Episode_Group))
+    combine(HashIgnoringCase(episode.release_group()));
+
+  return key;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static bool IsNumericElement(FeedFilterElement element) {
+  switch (element) {
+    case kFeedFilterElement_File_Size:
+    case kFeedFilterElement_Meta_Id:
+    case kFeedFilterElement_Meta_Episodes:
+    case kFeedFilterElement_Meta_Status:
+    case kFeedFilterElement_Meta_Type:
+    case kFeedFilterElement_User_Status:
+    case kFeedFilterElement_Episode_Number:
+    case kFeedFilterElement_Episode_Version:
+    case kFeedFilterElement_Local_EpisodeAvailable:
+      return true;
+    default:
+      return false;
+  }
+}
+
+static bool IsTextOperator(FeedFilterOperator op) {
+  switch (op) {
+    case kFeedFilterOperator_BeginsWith:
+    case kFeedFilterOperator_EndsWith:
+    case kFeedFilterOperator_Contains:
+    case kFeedFilterOperator_NotContains:
+      return true;
+    default:
+      return false;
+  }
+}
+
+CompiledFeedFilterCondition::CompiledFeedFilterCondition(
+    const FeedFilterCondition& condition)
+    : element_(condition.element),
+      op_(condition.op),
+      raw_value_(condition.value),
+      raw_resolution_(anime::TranslateResolution(condition.value)),
+      has_variables_(condition.value.find(L'%') != std::wstring::npos) {
+  // Without variables, the value is the same for every item. It can still
+  // have script functions and escaped characters, so it's expanded anyway.
+  if (!has_variables_)
+    value_ = ParseValue(ReplaceVariables(raw_value_, anime::Episode()));
+}
+
+CompiledFeedFilterCondition::Value CompiledFeedFilterCondition::ParseValue(
+    std::wstring text) const {
+  Value value;
+
+  // Empty values are compared as text
+  if (!text.empty()) {
+    if (element_ == kFeedFilterElement_File_Size) {
+      value.size = ParseSizeString(text);
+    } else if (IsNumericElement(element_)) {
+      value.is_true = IsEqual(text, L"True");
+      value.number = ToInt(text);
+    }
+  }
+
+  value.text = std::move(text);
+  return value;
+}
+
+bool CompiledFeedFilterCondition::Evaluate(
+    const FeedFilterContext& context) const {
+  const auto& item = context.item;
+  const auto anime = context.anime_item;
+
+  Value expanded_value;
+  if (has_variables_)
+    expanded_value =
+        ParseValue(ReplaceVariables(raw_value_, item.episode_data));
+  const auto& value = has_variables_ ? expanded_value : value_;
+
+  // Numbers are only converted to text if they're compared as text
+  bool has_number = false;
+  int number = 0;
   std::wstring element;
-  std::wstring value = ReplaceVariables(condition.value, item.episode_data);
-  auto anime = AnimeDatabase.FindItem(item.episode_data.anime_id);
 
-  switch (condition.element) {
+  switch (element_) {
     case kFeedFilterElement_File_Title:
       element = item.title;
       break;
@@ -51,12 +204,11 @@ bool EvaluateCondition(const FeedFilterCondition& condition,
       element = item.link;
       break;
     case kFeedFilterElement_File_Size:
-      element = ToWstr(item.file_size);
-      is_numeric = true;
+      has_number = true;
       break;
     case kFeedFilterElement_Meta_Id:
-      element = ToWstr(anime ? anime->GetId() : anime::ID_UNKNOWN);
-      is_numeric = true;
+      number = anime ? anime->GetId() : anime::ID_UNKNOWN;
+      has_number = true;
       break;
     case kFeedFilterElement_Episode_Title:
       element = item.episode_data.anime_title();
@@ -70,21 +222,22 @@ bool EvaluateCondition(const FeedFilterCondition& condition,
         element = anime->GetDateEnd().to_string();
       break;
     case kFeedFilterElement_Meta_Episodes:
-      if (anime)
-        element = ToWstr(anime->GetEpisodeCount());
-      is_numeric = true;
+      if (anime) {
+        number = anime->GetEpisodeCount();
+        has_number = true;
+      }
       break;
     case kFeedFilterElement_Meta_Status:
-      element = ToWstr(anime ? anime->GetAiringStatus() : anime::kUnknownStatus);
-      is_numeric = true;
+      number = anime ? anime->GetAiringStatus() : anime::kUnknownStatus;
+      has_number = true;
       break;
     case kFeedFilterElement_Meta_Type:
-      element = ToWstr(anime ? anime->GetType() : anime::kUnknownType);
-      is_numeric = true;
+      number = anime ? anime->GetType() : anime::kUnknownType;
+      has_number = true;
       break;
     case kFeedFilterElement_User_Status:
-      element = ToWstr(anime ? anime->GetMyStatus() : anime::kNotInList);
-      is_numeric = true;
+      number = anime ? anime->GetMyStatus() : anime::kNotInList;
+      has_number = true;
       break;
     case kFeedFilterElement_User_Tags:
       if (anime)
@@ -92,21 +245,24 @@ bool EvaluateCondition(const FeedFilterCondition& condition,
       break;
     case kFeedFilterElement_Episode_Number:
       if (!item.episode_data.episode_number()) {
-        element = anime ? ToWstr(anime->GetEpisodeCount()) : L"";
+        if (anime) {
+          number = anime->GetEpisodeCount();
+          has_number = true;
+        }
       } else {
-        element = ToWstr(anime::GetEpisodeHigh(item.episode_data));
+        number = context.episode_number;
+        has_number = true;
       }
-      is_numeric = true;
       break;
     case kFeedFilterElement_Episode_Version:
-      element = ToWstr(item.episode_data.release_version());  // defaults to 1
-      is_numeric = true;
+      number = item.episode_data.release_version();  // defaults to 1
+      has_number = true;
       break;
     case kFeedFilterElement_Local_EpisodeAvailable:
-      if (anime)
-        element = ToWstr(anime->IsEpisodeAvailable(
-            anime::GetEpisodeHigh(item.episode_data)));
-      is_numeric = true;
+      if (anime) {
+        number = anime->IsEpisodeAvailable(context.episode_number);
+        has_number = true;
+      }
       break;
     case kFeedFilterElement_Episode_Group:
       element = item.episode_data.release_group();
@@ -119,94 +275,99 @@ bool EvaluateCondition(const FeedFilterCondition& condition,
       break;
   }
 
-  if (element.empty() || value.empty())
-    is_numeric = false;
+  const bool is_numeric = has_number && !value.text.empty();
+  const bool is_file_size = element_ == kFeedFilterElement_File_Size;
+  const bool is_resolution =
+      element_ == kFeedFilterElement_Episode_VideoResolution;
 
-  switch (condition.op) {
+  if (has_number && (!is_numeric || IsTextOperator(op_)))
+    element = is_file_size ? ToWstr(item.file_size) : ToWstr(number);
+
+  switch (op_) {
     case kFeedFilterOperator_Equals:
       if (is_numeric) {
-        if (condition.element == kFeedFilterElement_File_Size)
-          return ToUint64(element) == ParseSizeString(value);
-        if (IsEqual(value, L"True"))
-          return ToInt(element) == TRUE;
-        return ToInt(element) == ToInt(value);
+        if (is_file_size)
+          return item.file_size == value.size;
+        if (value.is_true)
+          return number == TRUE;
+        return number == value.number;
       } else {
-        if (condition.element == kFeedFilterElement_Episode_VideoResolution) {
-          return anime::TranslateResolution(element) == anime::TranslateResolution(condition.value);
+        if (is_resolution) {
+          return context.video_resolution == raw_resolution_;
         } else {
-          return IsEqual(element, value);
+          return IsEqual(element, value.text);
         }
       }
     case kFeedFilterOperator_NotEquals:
       if (is_numeric) {
-        if (condition.element == kFeedFilterElement_File_Size)
-          return ToUint64(element) != ParseSizeString(value);
-        if (IsEqual(value, L"True"))
-          return ToInt(element) == TRUE;
-        return ToInt(element) != ToInt(value);
+        if (is_file_size)
+          return item.file_size != value.size;
+        if (value.is_true)
+          return number == TRUE;
+        return number != value.number;
       } else {
-        if (condition.element == kFeedFilterElement_Episode_VideoResolution) {
-          return anime::TranslateResolution(element) != anime::TranslateResolution(condition.value);
+        if (is_resolution) {
+          return context.video_resolution != raw_resolution_;
         } else {
-          return !IsEqual(element, value);
+          return !IsEqual(element, value.text);
         }
       }
     case kFeedFilterOperator_IsGreaterThan:
       if (is_numeric) {
-        if (condition.element == kFeedFilterElement_File_Size)
-          return ToUint64(element) > ParseSizeString(value);
-        return ToInt(element) > ToInt(value);
+        if (is_file_size)
+          return item.file_size > value.size;
+        return number > value.number;
       } else {
-        if (condition.element == kFeedFilterElement_Episode_VideoResolution) {
-          return anime::TranslateResolution(element) > anime::TranslateResolution(condition.value);
+        if (is_resolution) {
+          return context.video_resolution > raw_resolution_;
         } else {
-          return CompareStrings(element, condition.value) > 0;
+          return CompareStrings(element, raw_value_) > 0;
         }
       }
     case kFeedFilterOperator_IsGreaterThanOrEqualTo:
       if (is_numeric) {
-        if (condition.element == kFeedFilterElement_File_Size)
-          return ToUint64(element) >= ParseSizeString(value);
-        return ToInt(element) >= ToInt(value);
+        if (is_file_size)
+          return item.file_size >= value.size;
+        return number >= value.number;
       } else {
-        if (condition.element == kFeedFilterElement_Episode_VideoResolution) {
-          return anime::TranslateResolution(element) >= anime::TranslateResolution(condition.value);
+        if (is_resolution) {
+          return context.video_resolution >= raw_resolution_;
         } else {
-          return CompareStrings(element, condition.value) >= 0;
+          return CompareStrings(element, raw_value_) >= 0;
         }
       }
     case kFeedFilterOperator_IsLessThan:
       if (is_numeric) {
-        if (condition.element == kFeedFilterElement_File_Size)
-          return ToUint64(element) < ParseSizeString(value);
-        return ToInt(element) < ToInt(value);
+        if (is_file_size)
+          return item.file_size < value.size;
+        return number < value.number;
       } else {
-        if (condition.element == kFeedFilterElement_Episode_VideoResolution) {
-          return anime::TranslateResolution(element) < anime::TranslateResolution(condition.value);
+        if (is_resolution) {
+          return context.video_resolution < raw_resolution_;
         } else {
-          return CompareStrings(element, condition.value) < 0;
+          return CompareStrings(element, raw_value_) < 0;
         }
       }
     case kFeedFilterOperator_IsLessThanOrEqualTo:
       if (is_numeric) {
-        if (condition.element == kFeedFilterElement_File_Size)
-          return ToUint64(element) <= ParseSizeString(value);
-        return ToInt(element) <= ToInt(value);
+        if (is_file_size)
+          return item.file_size <= value.size;
+        return number <= value.number;
       } else {
-        if (condition.element == kFeedFilterElement_Episode_VideoResolution) {
-          return anime::TranslateResolution(element) <= anime::TranslateResolution(condition.value);
+        if (is_resolution) {
+          return context.video_resolution <= raw_resolution_;
         } else {
-          return CompareStrings(element, condition.value) <= 0;
+          return CompareStrings(element, raw_value_) <= 0;
         }
       }
     case kFeedFilterOperator_BeginsWith:
-      return StartsWith(element, value);
+      return StartsWith(element, value.text);
     case kFeedFilterOperator_EndsWith:
-      return EndsWith(element, value);
+      return EndsWith(element, value.text);
     case kFeedFilterOperator_Contains:
-      return InStr(element, value, 0, true) > -1;
+      return InStr(element, value.text, 0, true) > -1;
     case kFeedFilterOperator_NotContains:
-      return InStr(element, value, 0, true) == -1;
+      return InStr(element, value.text, 0, true) == -1;
   }
 
   return false;
@@ -269,23 +430,32 @@ void FeedFilter::AddCondition(FeedFilterElement element,
   conditions.back().value = value;
 }
 
-bool FeedFilter::Filter(Feed& feed, FeedItem& item, bool recursive) {
+void FeedFilter::Compile() {
+  compiled_conditions_.clear();
+  compiled_conditions_.reserve(conditions.size());
+
+  for (const auto& condition : conditions)
+    compiled_conditions_.emplace_back(condition);
+
+  sorted_anime_ids_ = anime_ids;
+  std::sort(sorted_anime_ids_.begin(), sorted_anime_ids_.end());
+}
+
+bool FeedFilter::Filter(Feed& feed, size_t index, FeedFilterPass& pass,
+                        bool recursive) {
   if (!enabled)
     return false;
 
+  auto& item = feed.items.at(index);
+  const auto& context = pass.contexts.at(index);
+
   // No need to filter if the item was discarded before
   if (item.IsDiscarded())
     return false;
 
-  if (!anime_ids.empty()) {
-    bool apply_filter = false;
-    for (const auto& id : anime_ids) {
-      if (id == item.episode_data.anime_id) {
-        apply_filter = true;
-        break;
-      }
-    }
-    if (!apply_filter)
+  if (!sorted_anime_ids_.empty()) {
+    if (!std::binary_search(sorted_anime_ids_.begin(), sorted_anime_ids_.end(),
+                            item.episode_data.anime_id))
       return false;  // Filter doesn't apply to this item
   }
 
@@ -295,8 +465,8 @@ bool FeedFilter::Filter(Feed& feed, FeedItem& item, bool recursive) {
   switch (match) {
     case kFeedFilterMatchAll:
       matched = true;
-      for (size_t i = 0; i < conditions.size(); i++) {
-        if (!EvaluateCondition(conditions.at(i), item)) {
+      for (size_t i = 0; i < compiled_conditions_.size(); i++) {
+        if (!compiled_conditions_.at(i).Evaluate(context)) {
           matched = false;
           condition_index = i;
           break;
@@ -305,8 +475,8 @@ bool FeedFilter::Filter(Feed& feed, FeedItem& item, bool recursive) {
       break;
     case kFeedFilterMatchAny:
       matched = false;
-      for (size_t i = 0; i < conditions.size(); i++) {
-        if (EvaluateCondition(conditions.at(i), item)) {
+      for (size_t i = 0; i < compiled_conditions_.size(); i++) {
+        if (compiled_conditions_.at(i).Evaluate(context)) {
           matched = true;
           condition_index = i;
           break;
@@ -348,7 +518,7 @@ bool FeedFilter::Filter(Feed& feed, FeedItem& item, bool recursive) {
           }
         } else {
           if (matched) {
-            if (!ApplyPreferenceFilter(feed, item))
+            if (!ApplyPreferenceFilter(feed, index, pass))
               return false;  // Filter didn't have any effect
           } else {
             return false;  // Filter doesn't apply to this item
@@ -379,8 +549,11 @@ bool FeedFilter::Filter(Feed& feed, FeedItem& item, bool recursive) {
   return true;
 }
 
-bool FeedFilter::ApplyPreferenceFilter(Feed& feed, FeedItem& item) {
+bool FeedFilter::ApplyPreferenceFilter(Feed& feed, size_t index,
+                                       FeedFilterPass& pass) {
+  const auto& item = feed.items.at(index);
   std::map<FeedFilterElement, bool> element_found;
+  unsigned int element_mask = 0;
 
   for (const auto& condition : conditions) {
     switch (condition.element) {
@@ -389,13 +562,16 @@ bool FeedFilter::ApplyPreferenceFilter(Feed& feed, FeedItem& item) {
       case kFeedFilterElement_Episode_Number:
       case kFeedFilterElement_Episode_Group:
         element_found[condition.element] = true;
+        element_mask |= 1u << condition.element;
         break;
     }
   }
 
   bool filter_applied = false;
 
-  for (auto& feed_item : feed.items) {
+  // Items outside of the bucket would fail the checks below anyway
+  for (const auto i : pass.FindSiblings(index, element_mask)) {
+    const auto& feed_item = feed.items.at(i);
     // Do not bother if the item was discarded before
     if (feed_item.IsDiscarded())
       continue;
@@ -424,7 +600,7 @@ bool FeedFilter::ApplyPreferenceFilter(Feed& feed, FeedItem& item) {
         continue;
 
     // Try applying the same filter
-    bool result = Filter(feed, feed_item, false);
+    bool result = Filter(feed, i, pass, false);
     filter_applied = filter_applied || result;
   }
 
@@ -446,7 +622,12 @@ FeedFilterPreset::FeedFilterPreset()
     : is_default(false) {
 }
 
-FeedFilterManager::FeedFilterManager() {
+FeedFilterManager::FeedFilterManager()
+    : FeedFilterManager(AnimeDatabase) {
+}
+
+FeedFilterManager::FeedFilterManager(anime::Database& database)
+    : database_(database) {
   InitializePresets();
   InitializeShortcodes();
 }
@@ -484,7 +665,7 @@ void FeedFilterManager::AddFilter(FeedFilterAction action,
 void FeedFilterManager::Cleanup() {
   foreach_(filter, filters) {
     foreach_(id, filter->anime_ids) {
-      if (!AnimeDatabase.FindItem(*id)) {
+      if (!database_.FindItem(*id)) {
         if (filter->anime_ids.size() > 1) {
           id = filter->anime_ids.erase(id) - 1;
           continue;
@@ -501,19 +682,53 @@ void FeedFilterManager::Filter(Feed& feed, bool preferences) {
   if (!Settings.GetBool(taiga::kTorrent_Filter_Enabled))
     return;
 
-  for (auto& item : feed.items) {
-    for (auto& filter : filters) {
-      if (preferences != (filter.action == kFeedFilterActionPrefer))
-        continue;
-      filter.Filter(feed, item, true);
+  // Conditions are parsed once per pass, as filters can change in between.
+  // Filters that are limited to certain anime are indexed by their IDs, so
+  // that each item only visits the filters that can apply to it. Indices are
+  // kept in order, because filters are applied in the order they're listed.
+  std::vector<size_t> unlimited_filters;
+  std::unordered_map<int, std::vector<size_t>> limited_filters;
+  for (size_t i = 0; i < filters.size(); ++i) {
+    auto& filter = filters.at(i);
+    if (!filter.enabled ||
+        preferences != (filter.action == kFeedFilterActionPrefer))
+      continue;
+    filter.Compile();
+    if (filter.anime_ids.empty()) {
+      unlimited_filters.push_back(i);
+    } else {
+      for (const auto& id : filter.anime_ids) {
+        auto& indices = limited_filters[id];
+        if (indices.empty() || indices.back() != i)
+          indices.push_back(i);
+      }
+    }
+  }
+
+  FeedFilterPass pass(feed, database_);
+
+  std::vector<size_t> item_filters;
+  for (size_t i = 0; i < feed.items.size(); ++i) {
+    const auto it =
+        limited_filters.find(feed.items.at(i).episode_data.anime_id);
+    if (it != limited_filters.end()) {
+      item_filters.clear();
+      std::merge(unlimited_filters.begin(), unlimited_filters.end(),
+                 it->second.begin(), it->second.end(),
+                 std::back_inserter(item_filters));
     }
+    const auto& indices =
+        it != limited_filters.end() ? item_filters : unlimited_filters;
+    for (const auto index : indices)
+      filters.at(index).Filter(feed, i, pass, true);
   }
 }
 
-void FeedFilterManager::FilterArchived(Feed& feed) {
+void FeedFilterManager::FilterArchived(Feed& feed,
+                                       const FeedArchive& archive) {
   for (auto& item : feed.items) {
     if (!item.IsDiscarded()) {
-      bool found = Aggregator.SearchArchive(item.title);
+      bool found = archive.Contains(item.title);
       if (found) {
         item.state = FeedItemState::DiscardedNormal;
         if (Taiga.debug_mode) {
@@ -527,7 +742,7 @@ void FeedFilterManager::FilterArchived(Feed& feed) {
 
 void FeedFilterManager::MarkNewEpisodes(Feed& feed) {
   for (auto& feed_item : feed.items) {
-    auto anime_item = AnimeDatabase.FindItem(feed_item.episode_data.anime_id);
+    auto anime_item = database_.FindItem(feed_item.episode_data.anime_id);
     if (anime_item) {
       int number = anime::GetEpisodeHigh(feed_item.episode_data);
       if (number > anime_item->GetMyLastWatchedEpisode())
@@ -867,7 +1082,7 @@ std::wstring FeedFilterManager::TranslateValue(
       if (condition.value.empty()) {
         return L"(?)";
       } else {
-        auto anime_item = AnimeDatabase.FindItem(ToInt(condition.value));
+        auto anime_item = database_.FindItem(ToInt(condition.value));
         if (anime_item) {
           return condition.value + L" (" + anime::GetPreferredTitle(*anime_item) + L")";
         } else {
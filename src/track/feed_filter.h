@@ -18,14 +18,22 @@
 
 #pragma once
 
+#include <cstdint>
 #include <map>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+namespace anime {
+class Database;
+class Item;
+}
 namespace pugi {
 class xml_node;
 }
 
+class FeedArchive;
+
 enum FeedFilterElement {
   kFeedFilterElement_None = -1,
   kFeedFilterElement_Meta_Id,
@@ -108,6 +116,67 @@ public:
   std::wstring value;
 };
 
+// Item data that conditions are evaluated against, which is looked up once for
+// each pass over a feed rather than for every condition.
+class FeedFilterContext {
+public:
+  FeedFilterContext(const FeedItem& item, anime::Database& database);
+
+  const FeedItem& item;
+  anime::Item* anime_item;
+  int episode_number;  // highest number, if the item is a range
+  int video_resolution;
+};
+
+// Data that is shared by all filters during a pass over a feed.
+class FeedFilterPass {
+public:
+  FeedFilterPass(const Feed& feed, anime::Database& database);
+  ~FeedFilterPass() {}
+
+  // Items that may be the same release as the one at index, disregarding the
+  // elements in mask (bits are 1 << FeedFilterElement), in the order of the
+  // feed. Items are grouped once for each mask, so that preferences don't
+  // have to look through the whole feed for every item that they match.
+  const std::vector<size_t>& FindSiblings(size_t index, unsigned int mask);
+
+  std::vector<FeedFilterContext> contexts;
+
+private:
+  size_t GetSiblingKey(size_t index, unsigned int mask) const;
+
+  const Feed& feed_;
+  std::map<unsigned int, std::unordered_map<size_t, std::vector<size_t>>>
+      siblings_;
+};
+
+// A condition with its value parsed in advance. Values that have variables
+// depend on the item, so they're expanded and parsed for each item instead.
+class CompiledFeedFilterCondition {
+public:
+  explicit CompiledFeedFilterCondition(const FeedFilterCondition& condition);
+  ~CompiledFeedFilterCondition() {}
+
+  bool Evaluate(const FeedFilterContext& context) const;
+
+private:
+  struct Value {
+    std::wstring text;
+    bool is_true = false;
+    int number = 0;
+    uint64_t size = 0;
+  };
+
+  Value ParseValue(std::wstring text) const;
+
+  FeedFilterElement element_;
+  FeedFilterOperator op_;
+  std::wstring raw_value_;
+  int raw_resolution_;
+  bool has_variables_;
+  Value value_;  // unless the value has variables
+};
+
 class FeedFilter {
 public:
   FeedFilter();
@@ -116,11 +185,12 @@ public:
   FeedFilter& operator=(const FeedFilter& filter);
 
   void AddCondition(FeedFilterElement element, FeedFilterOperator op, const std::wstring& value);
-  bool Filter(Feed& feed, FeedItem& item, bool recursive);
+  void Compile();
+  bool Filter(Feed& feed, size_t index, FeedFilterPass& pass, bool recursive);
   void Reset();
 
 public:
-  bool ApplyPreferenceFilter(Feed& feed, FeedItem& item);
+  bool ApplyPreferenceFilter(Feed& feed, size_t index, FeedFilterPass& pass);
 
   std::wstring name;
   bool enabled;
@@ -131,6 +201,11 @@ public:
 
   std::vector<int> anime_ids;
   std::vector<FeedFilterCondition> conditions;
+
+private:
+  // Rebuilt from conditions and anime_ids before each pass over a feed
+  std::vector<CompiledFeedFilterCondition> compiled_conditions_;
+  std::vector<int> sorted_anime_ids_;
 };
 
 class FeedFilterPreset {
@@ -146,6 +221,9 @@ public:
 class FeedFilterManager {
 public:
   FeedFilterManager();
+  // Anime conditions are evaluated against the given database instead of the
+  // one that is loaded
+  explicit FeedFilterManager(anime::Database& database);
   ~FeedFilterManager() {}
 
   void InitializePresets();
@@ -155,7 +233,7 @@ public:
   void AddFilter(FeedFilterAction action, FeedFilterMatch match, FeedFilterOption option, bool enabled, const std::wstring& name);
   void Cleanup();
   void Filter(Feed& feed, bool preferences);
-  void FilterArchived(Feed& feed);
+  void FilterArchived(Feed& feed, const FeedArchive& archive);
   void MarkNewEpisodes(Feed& feed);
 
   bool Import(const std::wstring& input, std::vector<FeedFilter>& filters);
@@ -181,6 +259,8 @@ public:
   std::vector<FeedFilterPreset> presets;
 
 private:
+  anime::Database& database_;
+
   std::map<int, std::wstring> action_shortcodes_;
   std::map<int, std::wstring> element_shortcodes_;
   std::map<int, std::wstring> match_shortcodes_;
@@ -388,6 +388,7 @@ void ProcessMediaPlayerTitle(const MediaPlayer& media_player) {
       return;
 
     // Examine title and compare it with list items
+    track::recognition::sorted_scores_t scores;
     static track::recognition::ParseOptions parse_options;
     parse_options.parse_path = true;
     parse_options.streaming_media = media_player.type == anisthesia::PlayerType::WebBrowser;
@@ -398,7 +399,7 @@ void ProcessMediaPlayerTitle(const MediaPlayer& media_player) {
       match_options.check_anime_type = true;
       match_options.check_episode_number = true;
       match_options.streaming_media = media_player.type == anisthesia::PlayerType::WebBrowser;
-      auto anime_id = Meow.Identify(CurrentEpisode, true, match_options);
+      auto anime_id = Meow.Identify(CurrentEpisode, match_options, scores);
       if (anime::IsValidId(anime_id)) {
         // Recognized
         anime_item = AnimeDatabase.FindItem(anime_id);
@@ -410,7 +411,7 @@ void ProcessMediaPlayerTitle(const MediaPlayer& media_player) {
     }
     // Not recognized
     CurrentEpisode.Set(anime::ID_NOTINLIST);
-    ui::OnRecognitionFail();
+    ui::OnRecognitionFail(scores);
 
   } else {
     if (MediaPlayers.title_changed()) {
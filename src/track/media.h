@@ -95,6 +95,7 @@ struct StreamData {
   enum_t option_id;
   std::wstring name;
   std::wstring url;
+  std::vector<std::string> url_keywords;  // at least one is in matching URLs
   std::regex url_pattern;
   std::regex title_pattern;
 };
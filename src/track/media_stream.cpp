@@ -18,10 +18,10 @@
 
 #include <regex>
 #include <set>
+#include <string_view>
 
 #include "base/process.h"
 #include "base/string.h"
-#include "base/url.h"
 #include "library/anime_episode.h"
 #include "taiga/settings.h"
 #include "track/media.h"
@@ -36,6 +36,7 @@ static const std::vector<StreamData> stream_data{
     taiga::kStream_Animelab,
     L"AnimeLab",
     L"https://www.animelab.com",
+    {"animelab.com/player/"},
     std::regex("animelab\\.com/player/"),
     std::regex("AnimeLab - (.+)"),
   },
@@ -45,6 +46,7 @@ static const std::vector<StreamData> stream_data{
     taiga::kStream_Adn,
     L"Anime Digital Network",
     L"https://animedigitalnetwork.fr/video/",
+    {"animedigitalnetwork"},
     std::regex("animedigitalnetwork.fr/video/[^/]+/[0-9]+"),
     std::regex("(.+) - streaming -.* ADN"),
   },
@@ -54,6 +56,7 @@ static const std::vector<StreamData> stream_data{
     taiga::kStream_Ann,
     L"Anime News Network",
     L"https://www.animenewsnetwork.com/video/",
+    {"animenewsnetwork."},
     std::regex("animenewsnetwork\\.(?:com|cc)/video/[0-9]+"),
     std::regex("(.+) - Anime News Network"),
   },
@@ -63,6 +66,7 @@ static const std::vector<StreamData> stream_data{
     taiga::kStream_Crunchyroll,
     L"Crunchyroll",
     L"http://www.crunchyroll.com",
+    {"crunchyroll."},
     std::regex(
       "crunchyroll\\.[a-z.]+/[^/]+/(?:[^/]+/)?(?:"
         "episode-[0-9]+.*|"
@@ -77,6 +81,7 @@ static const std::vector<StreamData> stream_data{
     taiga::kStream_Funimation,
     L"Funimation",
     L"https://www.funimation.com",
+    {"funimation.com/shows/"},
     std::regex("funimation\\.com/shows/[^/]+/[^/]+/"),
     std::regex("(?:Watch )?(.+) Anime.* (?:on|-) Funimation"),
   },
@@ -86,6 +91,7 @@ static const std::vector<StreamData> stream_data{
     taiga::kStream_Hidive,
     L"HIDIVE",
     L"https://www.hidive.com",
+    {"hidive.com/stream/"},
     std::regex("hidive\\.com/stream/"),
     std::regex("Stream (.+) on HIDIVE"),
   },
@@ -95,6 +101,7 @@ static const std::vector<StreamData> stream_data{
     taiga::kStream_Plex,
     L"Plex Web App",
     L"https://www.plex.tv",
+    {"plex", ":32400/web/"},
     std::regex(
       "^app\\.plex\\.tv/desktop|"
       "^[^/]*?plex\\.tv/web/|"
@@ -111,6 +118,7 @@ static const std::vector<StreamData> stream_data{
     taiga::kStream_Veoh,
     L"Veoh",
     L"http://www.veoh.com",
+    {"veoh.com/watch/"},
     std::regex("veoh\\.com/watch/"),
     std::regex("Watch Videos Online \\| (.+) \\| Veoh\\.com"),
   },
@@ -120,6 +128,7 @@ static const std::vector<StreamData> stream_data{
     taiga::kStream_Viz,
     L"VIZ",
     L"https://www.viz.com/watch",
+    {"viz.com/watch/streaming/"},
     std::regex("viz\\.com/watch/streaming/[^/]+-(?:episode-[0-9]+|movie)/"),
     std::regex("(.+) // VIZ"),
   },
@@ -129,6 +138,7 @@ static const std::vector<StreamData> stream_data{
     taiga::kStream_Vrv,
     L"VRV",
     L"https://vrv.co",
+    {"vrv.co/watch/"},
     std::regex("vrv\\.co/watch/"),
     std::regex("(.+) - Watch on VRV"),
   },
@@ -138,6 +148,7 @@ static const std::vector<StreamData> stream_data{
     taiga::kStream_Wakanim,
     L"Wakanim",
     L"https://www.wakanim.tv",
+    {"wakanim.tv/"},
     std::regex("wakanim\\.tv/[^/]+/v2/catalogue/episode/[^/]+/"),
     std::regex("(.+) (?:auf|on|sur) Wakanim\\.TV.*"),
   },
@@ -147,6 +158,7 @@ static const std::vector<StreamData> stream_data{
     taiga::kStream_Yahoo,
     L"Yahoo View",
     L"https://view.yahoo.com",
+    {"yahoo"},
     std::regex("view.yahoo.com/show/[^/]+/episode/[^/]+/"),
     std::regex("Watch .+ Free Online - (.+) \\| Yahoo View"),
   },
@@ -156,6 +168,7 @@ static const std::vector<StreamData> stream_data{
     taiga::kStream_Youtube,
     L"YouTube",
     L"https://www.youtube.com",
+    {"youtube.com/watch"},
     std::regex("youtube\\.com/watch"),
     std::regex(u8"YouTube|(?:\u25B6 )?(.+) - YouTube"),
   },
@@ -165,6 +178,17 @@ const std::vector<StreamData>& GetStreamData() {
   return stream_data;
 }
 
+// Patterns are only tried if the URL contains one of their keywords, which
+// rules out most URLs without running any regular expressions.
+static bool ContainsUrlKeyword(const std::string& url,
+                               const StreamData& item) {
+  for (const auto& keyword : item.url_keywords) {
+    if (url.find(keyword) != std::string::npos)
+      return true;
+  }
+  return false;
+}
+
 const StreamData* FindStreamFromUrl(std::wstring url) {
   EraseLeft(url, L"http://");
   EraseLeft(url, L"https://");
@@ -175,7 +199,8 @@ const StreamData* FindStreamFromUrl(std::wstring url) {
   const std::string str = WstrToStr(url);
 
   for (const auto& item : stream_data) {
-    if (std::regex_search(str, item.url_pattern)) {
+    if (ContainsUrlKeyword(str, item) &&
+        std::regex_search(str, item.url_pattern)) {
       const bool enabled = Settings.GetBool(item.option_id);
       return enabled ? &item : nullptr;
     }
@@ -267,10 +292,30 @@ bool GetTitleFromStreamingMediaProvider(const std::wstring& url,
 
 ////////////////////////////////////////////////////////////////////////////////
 
+// Same as Url(address).host, without cracking the path and query, which is
+// done for every tab on every check.
+static std::wstring_view GetUrlHost(std::wstring_view address) {
+  const auto begin = address.find_first_not_of(L"\t\n\r ");
+  if (begin == address.npos)
+    return {};
+  address = address.substr(begin, address.find_last_not_of(L"\t\n\r ") -
+                                  begin + 1);
+
+  const auto i = address.find(L"://");
+  if (i != address.npos) {
+    address.remove_prefix(i + 3);
+  } else if (address.substr(0, 2) == L"//") {
+    address.remove_prefix(2);
+  }
+
+  address = address.substr(0, address.find(L'/'));
+  return address.substr(0, address.find(L':'));
+}
+
 void IgnoreCommonWebBrowserTitles(const std::wstring& address,
                                   std::wstring& title) {
-  const Url url(address);
-  if (!url.host.empty() && StartsWith(title, url.host))  // Chrome
+  const auto host = GetUrlHost(address);
+  if (!host.empty() && title.compare(0, host.size(), host) == 0)  // Chrome
     title.clear();
   if (StartsWith(title, L"http://") || StartsWith(title, L"https://"))
     title.clear();
@@ -16,10 +16,13 @@
 ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+
 #include <anitomy/anitomy/anitomy.h>
 #include <anitomy/anitomy/keyword.h>
 
 #include "base/log.h"
+#include "base/parallel.h"
 #include "base/string.h"
 #include "library/anime.h"
 #include "library/anime_db.h"
@@ -33,6 +36,60 @@ track::recognition::Engine Meow;
 namespace track {
 namespace recognition {
 
+Engine::Engine() : database_(AnimeDatabase), detached_(false) {
+}
+
+Engine::Engine(anime::Database& database)
+    : database_(database), detached_(&database != &AnimeDatabase) {
+}
+
+// Anitomy instances are reused, so that their buffers aren't allocated again for
+// every call. They can't be shared between threads, hence a set for each.
+struct Parsers {
+  Parsers() {
+    season.options().parse_episode_number = false;
+    season.options().parse_episode_title = false;
+    season.options().parse_file_extension = false;
+    season.options().parse_release_group = false;
+
+    directory.options().parse_episode_number = false;
+    directory.options().parse_episode_title = false;
+    directory.options().parse_file_extension = false;
+    directory.options().parse_release_group = true;
+  }
+
+  anitomy::Anitomy file;
+  anitomy::Anitomy streaming;
+  anitomy::Anitomy season;
+  anitomy::Anitomy directory;
+  unsigned int generation = 0;
+};
+
+static Parsers& GetParsers() {
+  thread_local Parsers parsers;
+  return parsers;
+}
+
+void Engine::UpdateParserOptions() {
+  // Options are built again on the next call to Parse
+  std::lock_guard<std::mutex> lock(parser_options_mutex_);
+  parser_options_.reset();
+  ++parser_options_generation_;
+}
+
+std::shared_ptr<const Engine::ParserOptions> Engine::GetParserOptions() const {
+  std::lock_guard<std::mutex> lock(parser_options_mutex_);
+  if (!parser_options_) {
+    auto parser_options = std::make_shared<ParserOptions>();
+    Split(Settings[taiga::kRecognition_IgnoredStrings], L"|",
+          parser_options->file.ignored_strings);
+    parser_options->streaming = parser_options->file;
+    parser_options->streaming.allowed_delimiters = L" ";
+    parser_options_ = std::move(parser_options);
+  }
+  return parser_options_;
+}
+
 bool Engine::Parse(std::wstring filename, const ParseOptions& parse_options,
                    anime::Episode& episode) const {
   // Clear previous data
@@ -49,13 +106,16 @@ bool Engine::Parse(std::wstring filename, const ParseOptions& parse_options,
   if (filename.empty())
     return false;
 
-  anitomy::Anitomy anitomy_instance;
-
-  // Set Anitomy options
-  if (parse_options.streaming_media)
-    anitomy_instance.options().allowed_delimiters = L" ";
-  Split(Settings[taiga::kRecognition_IgnoredStrings], L"|",
-        anitomy_instance.options().ignored_strings);
+  auto& parsers = GetParsers();
+  const unsigned int generation = parser_options_generation_;
+  if (parsers.generation != generation) {
+    const auto parser_options = GetParserOptions();
+    parsers.file.options() = parser_options->file;
+    parsers.streaming.options() = parser_options->streaming;
+    parsers.generation = generation;
+  }
+  auto& anitomy_instance = parse_options.streaming_media ?
+      parsers.streaming : parsers.file;
 
   if (!anitomy_instance.Parse(filename)) {
     LOGD(L"Could not parse filename: {}", filename);
@@ -70,13 +130,118 @@ bool Engine::Parse(std::wstring filename, const ParseOptions& parse_options,
   return true;
 }
 
+void Engine::ParseBatch(const std::vector<std::wstring>& filenames,
+                        const ParseOptions& parse_options,
+                        std::vector<anime::Episode>& episodes,
+                        std::vector<char>& results) const {
+  episodes.clear();
+  episodes.resize(filenames.size());
+  results.assign(filenames.size(), false);
+
+  base::ParallelFor(filenames.size(), [&](size_t i) {
+    results[i] = Parse(filenames[i], parse_options, episodes[i]);
+  });
+}
+
 int Engine::Identify(anime::Episode& episode, bool give_score,
-                     const MatchOptions& match_options) {
-  std::set<int> anime_ids;
+                     const MatchOptions& match_options) const {
+  if (give_score) {
+    sorted_scores_t scores;
+    return Identify(episode, match_options, scores);
+  }
+
+  InitializeTitlesOnce();
+  IdentifyTitleCached(episode, match_options);
+  PostProcess(episode);
+
+  return episode.anime_id;
+}
+
+int Engine::Identify(anime::Episode& episode,
+                     const MatchOptions& match_options,
+                     sorted_scores_t& scores) const {
+  InitializeTitlesOnce();
+
+  scores.clear();
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    IdentifyTitle(episode, true, match_options, scores);
+  }
+
+  PostProcess(episode);
+
+  return episode.anime_id;
+}
+
+void Engine::IdentifyBatch(std::vector<anime::Episode>& episodes,
+                           const MatchOptions& match_options,
+                           batch_callback_t callback) const {
+  InitializeTitlesOnce();
+
+  // Lookups are independent of each other, so they can run in parallel.
+  base::ParallelFor(episodes.size(), [&](size_t i) {
+    IdentifyTitleCached(episodes[i], match_options);
+  });
+
+  // Post-processing reads the database, which the callback may modify (e.g.
+  // available episodes), so it is done in order on the calling thread.
+  for (size_t i = 0; i < episodes.size(); ++i) {
+    PostProcess(episodes[i]);
+    if (callback && callback(i))
+      break;
+  }
+}
+
+void Engine::IdentifyTitleCached(anime::Episode& episode,
+                                 const MatchOptions& match_options) const {
+  const auto cache_key = GetCacheKey(episode, match_options);
+  unsigned int generation = 0;
+  if (!FindCachedResult(cache_key, episode, generation)) {
+    sorted_scores_t scores;
+    {
+      std::shared_lock<std::shared_mutex> lock(mutex_);
+      IdentifyTitle(episode, false, match_options, scores);
+    }
+    AddCachedResult(cache_key, episode, generation);
+  }
+}
+
+void Engine::PostProcess(anime::Episode& episode) const {
+  if (anime::IsValidId(episode.anime_id)) {
+    // Here we check the element rather than episode_number(), in order to
+    // prevent overwriting episode 0.
+    if (episode.elements().empty(anitomy::kElementEpisodeNumber)) {
+      if (!episode.file_extension().empty()) {
+        episode.set_episode_number(1);
+      } else if (episode.elements().empty(anitomy::kElementVolumeNumber)) {
+        auto anime_item = database_.FindItem(episode.anime_id);
+        if (anime_item) {
+          const int last_episode = [&anime_item]() {
+            switch (anime_item->GetAiringStatus()) {
+              case anime::kFinishedAiring:
+                return anime_item->GetEpisodeCount();
+              case anime::kAiring:
+                return anime::GetLastEpisodeNumber(*anime_item);
+              default:
+                return 0;
+            }
+          }();
+          if (last_episode)
+            episode.set_episode_number_range({1, last_episode});
+        }
+      }
+    }
+  }
+}
 
-  InitializeTitles();
+void Engine::IdentifyTitle(anime::Episode& episode, bool give_score,
+                           const MatchOptions& match_options,
+                           sorted_scores_t& scores) const {
+  std::set<int> anime_ids;
 
   auto valide_ids = [&](anime::Episode& episode) {
+    StageTimer timer(*this, kStageValidation);
+    const size_t candidates = anime_ids.size();
     for (auto it = anime_ids.begin(); it != anime_ids.end(); ) {
       if (!ValidateOptions(episode, *it, match_options, true)) {
         it = anime_ids.erase(it);
@@ -84,10 +249,14 @@ int Engine::Identify(anime::Episode& episode, bool give_score,
         ++it;
       }
     }
+    timer.AddCandidates(candidates);
+    if (!anime_ids.empty())
+      timer.Hit();
   };
 
   auto look_up_merged_title = [&](
       const std::initializer_list<anitomy::ElementCategory>& elements) {
+    StageTimer timer(*this, kStageMergedTitleLookup);
     anime::Episode episode_merged_title(episode);
     auto merged_title = episode.anime_title();
     for (const auto& element : elements) {
@@ -96,8 +265,10 @@ int Engine::Identify(anime::Episode& episode, bool give_score,
     }
     episode_merged_title.set_anime_title(merged_title);
     LookUpTitle(episode_merged_title.anime_title(), anime_ids);
+    timer.AddCandidates(anime_ids.size());
     valide_ids(episode_merged_title);
     if (!anime_ids.empty()) {
+      timer.Hit();
       std::swap(episode_merged_title, episode);
       LOGD(L"Merged title lookup succeeded: {}", episode.anime_title());
     }
@@ -122,20 +293,27 @@ int Engine::Identify(anime::Episode& episode, bool give_score,
 
   // Look up anime title
   if (anime_ids.empty()) {
+    StageTimer timer(*this, kStageTitleLookup);
     LookUpTitle(episode.anime_title(), anime_ids);
+    timer.AddCandidates(anime_ids.size());
     valide_ids(episode);
+    if (!anime_ids.empty())
+      timer.Hit();
   }
 
   // Look up parent directories
   if (anime_ids.empty() && !episode.folder.empty() &&
       Settings.GetBool(taiga::kRecognition_LookupParentDirectories) &&
       episode.anime_type().empty()) {
+    StageTimer timer(*this, kStageDirectoryLookup);
     anime::Episode episode_from_directory(episode);
     episode_from_directory.elements().erase(anitomy::kElementAnimeTitle);
     if (GetTitleFromPath(episode_from_directory)) {
       LookUpTitle(episode_from_directory.anime_title(), anime_ids);
+      timer.AddCandidates(anime_ids.size());
       valide_ids(episode_from_directory);
       if (!anime_ids.empty()) {
+        timer.Hit();
         std::swap(episode_from_directory, episode);
         LOGD(L"Parent directory lookup succeeded: {} -> {}",
              episode_from_directory.anime_title(),
@@ -147,7 +325,7 @@ int Engine::Identify(anime::Episode& episode, bool give_score,
   // Figure out which ID is the one we're looking for
   if (anime::IsValidId(episode.anime_id)) {
     // We had a redirection while validating IDs
-    if (!AnimeDatabase.FindItem(episode.anime_id, false)) {
+    if (!database_.FindItem(episode.anime_id, false)) {
       episode.anime_id = anime::ID_UNKNOWN;
       LOGD(L"Redirection failed, because destination ID is not available in the "
            L"database.");
@@ -155,53 +333,30 @@ int Engine::Identify(anime::Episode& episode, bool give_score,
   } else if (anime_ids.size() == 1) {
     episode.anime_id = *anime_ids.begin();
   } else if (anime_ids.size() > 1) {
-    episode.anime_id = ScoreTitle(episode, anime_ids, match_options);
+    episode.anime_id =
+        ScoreTitle(episode, anime_ids, match_options, give_score, scores);
   } else if (anime_ids.empty() && give_score) {
-    ScoreTitle(episode, anime_ids, match_options);
-  }
-
-  // Post-processing
-  if (anime::IsValidId(episode.anime_id)) {
-    // Here we check the element rather than episode_number(), in order to
-    // prevent overwriting episode 0.
-    if (episode.elements().empty(anitomy::kElementEpisodeNumber)) {
-      if (!episode.file_extension().empty()) {
-        episode.set_episode_number(1);
-      } else if (episode.elements().empty(anitomy::kElementVolumeNumber)) {
-        auto anime_item = AnimeDatabase.FindItem(episode.anime_id);
-        if (anime_item) {
-          const int last_episode = [&anime_item]() {
-            switch (anime_item->GetAiringStatus()) {
-              case anime::kFinishedAiring:
-                return anime_item->GetEpisodeCount();
-              case anime::kAiring:
-                return anime::GetLastEpisodeNumber(*anime_item);
-              default:
-                return 0;
-            }
-          }();
-          if (last_episode)
-            episode.set_episode_number_range({1, last_episode});
-        }
-      }
-    }
+    ScoreTitle(episode, anime_ids, match_options, give_score, scores);
   }
-
-  return episode.anime_id;
 }
 
-bool Engine::Search(const std::wstring& title, std::vector<int>& anime_ids) {
+bool Engine::Search(const std::wstring& title,
+                    std::vector<int>& anime_ids) const {
   anime::Episode episode;
   episode.set_anime_title(title);
 
   std::set<int> empty_set;
   track::recognition::MatchOptions default_options;
+  sorted_scores_t scores;
 
-  InitializeTitles();
+  InitializeTitlesOnce();
 
-  ScoreTitle(episode, empty_set, default_options);
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    ScoreTitle(episode, empty_set, default_options, true, scores);
+  }
 
-  for (const auto& score : scores_) {
+  for (const auto& score : scores) {
     anime_ids.push_back(score.first);
   }
 
@@ -211,38 +366,57 @@ bool Engine::Search(const std::wstring& title, std::vector<int>& anime_ids) {
 ////////////////////////////////////////////////////////////////////////////////
 
 void Engine::InitializeTitles() {
-  static bool initialized = false;
+  std::call_once(initialized_, [this]() {
+    const auto checksum = !detached_ ? GetSnapshotChecksum() : 0;
+    if (!detached_ && LoadSnapshot(checksum))
+      return;
 
-  if (!initialized) {
-    initialized = true;
-    for (const auto& it : AnimeDatabase.items) {
+    for (const auto& it : database_.items) {
       UpdateTitles(it.second);
     }
 
     ReadRelations();
-  }
+
+    if (!detached_)
+      SaveSnapshot(checksum);
+  });
+}
+
+// Indexing the titles is the only change that a query makes to the engine. It
+// happens once, and all queries wait for it before they read the titles.
+void Engine::InitializeTitlesOnce() const {
+  const_cast<Engine*>(this)->InitializeTitles();
 }
 
 void Engine::UpdateTitles(const anime::Item& anime_item, bool erase_ids) {
   const int anime_id = anime_item.GetId();
 
-  db_[anime_id].normal_titles.clear();
-  db_[anime_id].trigrams.clear();
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+
+  InvalidateCache();
+
+  auto store = GetScoreStore(anime_id);
+  if (!store)
+    return;
+
+  EraseTrigramPostings(anime_id);
+  store->normal_titles.clear();
+  store->trigrams.clear();
 
   if (erase_ids) {
-    auto erase_id = [&anime_id](Titles::container_t& titles) {
-      for (auto& title : titles) {
-        title.second.erase(anime_id);
-      }
-    };
-    erase_id(titles_.alternative);
-    erase_id(titles_.main);
-    erase_id(titles_.user);
-    erase_id(normal_titles_.alternative);
-    erase_id(normal_titles_.main);
-    erase_id(normal_titles_.user);
+    for (const auto& key : store->title_keys) {
+      key.titles->Erase(key.index, anime_id);
+    }
+    store->title_keys.clear();
   }
 
+  auto insert_title = [&](const std::wstring& title,
+                          Titles::container_t& titles) {
+    const auto index = titles.Insert(title, anime_id);
+    if (index != TitleTable::npos)
+      store->title_keys.push_back({&titles, index});
+  };
+
   auto update_title = [&](std::wstring title,
                           Titles::container_t& titles,
                           Titles::container_t& normal_titles) {
@@ -250,14 +424,14 @@ void Engine::UpdateTitles(const anime::Item& anime_item, bool erase_ids) {
       Normalize(title, kNormalizeForTrigrams, false);
       trigram_container_t trigrams;
       GetTrigrams(title, trigrams);
-      db_[anime_id].trigrams.push_back(trigrams);
-      db_[anime_id].normal_titles.push_back(title);
+      store->trigrams.push_back(trigrams);
+      store->normal_titles.push_back(title);
 
       Normalize(title, kNormalizeForLookup, true);
-      titles[title].insert(anime_id);
+      insert_title(title, titles);
 
       Normalize(title, kNormalizeFull, true);
-      normal_titles[title].insert(anime_id);
+      insert_title(title, normal_titles);
     }
   };
 
@@ -280,6 +454,71 @@ void Engine::UpdateTitles(const anime::Item& anime_item, bool erase_ids) {
   for (const auto& synonym : anime_item.GetUserSynonyms()) {
     update_title(synonym, titles_.user, normal_titles_.user);
   }
+
+  AddTrigramPostings(anime_id);
+}
+
+const Engine::ScoreStore* Engine::FindScoreStore(int anime_id) const {
+  if (anime_id < 0 || static_cast<size_t>(anime_id) >= db_index_.size())
+    return nullptr;
+  const auto index = db_index_[anime_id];
+  return index ? &db_[index - 1] : nullptr;
+}
+
+Engine::ScoreStore* Engine::GetScoreStore(int anime_id) {
+  if (anime_id < 0)
+    return nullptr;
+  if (static_cast<size_t>(anime_id) >= db_index_.size())
+    db_index_.resize(anime_id + 1);
+  auto& index = db_index_[anime_id];
+  if (!index) {
+    db_.emplace_back();
+    index = static_cast<unsigned int>(db_.size());
+  }
+  return &db_[index - 1];
+}
+
+void Engine::AddTrigramPostings(int anime_id) {
+  const auto store = FindScoreStore(anime_id);
+  if (!store)
+    return;
+
+  const auto& trigrams = store->trigrams;
+
+  for (size_t i = 0; i < trigrams.size(); ++i) {
+    // Trigrams are sorted, so that duplicates are next to each other
+    const auto& container = trigrams[i];
+    for (auto it = container.begin(); it != container.end(); ) {
+      auto it_end = std::find_if(it, container.end(),
+          [&it](const trigram_t& trigram) { return trigram != *it; });
+      trigram_index_[*it].push_back({
+          anime_id,
+          static_cast<unsigned short>(i),
+          static_cast<unsigned short>(std::distance(it, it_end))});
+      it = it_end;
+    }
+  }
+}
+
+void Engine::EraseTrigramPostings(int anime_id) {
+  const auto store = FindScoreStore(anime_id);
+  if (!store)
+    return;
+
+  for (const auto& container : store->trigrams) {
+    for (const auto& trigram : container) {
+      auto postings = trigram_index_.find(trigram);
+      if (postings == trigram_index_.end())
+        continue;  // Already erased for a duplicate trigram
+      auto& list = postings->second;
+      list.erase(std::remove_if(list.begin(), list.end(),
+          [&anime_id](const TrigramPosting& posting) {
+            return posting.anime_id == anime_id;
+          }), list.end());
+      if (list.empty())
+        trigram_index_.erase(postings);
+    }
+  }
 }
 
 int Engine::LookUpTitle(std::wstring title, std::set<int>& anime_ids) const {
@@ -288,9 +527,7 @@ int Engine::LookUpTitle(std::wstring title, std::set<int>& anime_ids) const {
   auto find_title = [&](const std::wstring& title,
                         const Titles::container_t& container) {
     if (!anime::IsValidId(anime_id)) {
-      auto it = container.find(title.c_str());
-      if (it != container.end()) {
-        anime_ids.insert(it->second.begin(), it->second.end());
+      if (container.Find(title, anime_ids)) {
         if (anime_ids.size() == 1)
           anime_id = *anime_ids.begin();
       }
@@ -353,7 +590,7 @@ void Engine::ExtendAnimeTitle(anime::Episode& episode) const {
   }
 }
 
-bool Engine::GetTitleFromPath(anime::Episode& episode) {
+bool Engine::GetTitleFromPath(anime::Episode& episode) const {
   if (episode.folder.empty())
     return false;
 
@@ -386,11 +623,7 @@ bool Engine::GetTitleFromPath(anime::Episode& episode) {
   };
 
   auto get_season_number = [](const std::wstring& str) {
-    anitomy::Anitomy anitomy_instance;
-    anitomy_instance.options().parse_episode_number = false;
-    anitomy_instance.options().parse_episode_title = false;
-    anitomy_instance.options().parse_file_extension = false;
-    anitomy_instance.options().parse_release_group = false;
+    auto& anitomy_instance = GetParsers().season;
     anitomy_instance.Parse(str);
     auto it = anitomy_instance.elements().find(anitomy::kElementAnimeSeason);
     if (it != anitomy_instance.elements().end())
@@ -423,11 +656,7 @@ bool Engine::GetTitleFromPath(anime::Episode& episode) {
   } else {
     // We're parsing the directory name in case it looks like
     // "[Fansub] Anime Title [Stuff]" rather than just "Anime Title".
-    anitomy::Anitomy anitomy_instance;
-    anitomy_instance.options().parse_episode_number = false;
-    anitomy_instance.options().parse_episode_title = false;
-    anitomy_instance.options().parse_file_extension = false;
-    anitomy_instance.options().parse_release_group = true;
+    auto& anitomy_instance = GetParsers().directory;
     if (anitomy_instance.Parse(episode.anime_title())) {
       auto& elements = anitomy_instance.elements();
       const auto valid_elements = {
@@ -18,15 +18,29 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <set>
+#include <shared_mutex>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
+#include <anitomy/anitomy/options.h>
+
 #include "base/string.h"
+#include "base/time.h"
+#include "library/anime_episode.h"
 
 namespace anime {
-class Episode;
+class Database;
 class Item;
 }
 
@@ -49,17 +63,147 @@ struct MatchOptions {
   bool streaming_media = false;
 };
 
+// Number of services that anime relations list IDs for
+constexpr size_t kRelationServiceCount = 3;
+
+// Episode redirection rule, with the IDs of every service (0 if unknown)
+struct RelationRule {
+  int source_ids[kRelationServiceCount] = {};
+  int destination_ids[kRelationServiceCount] = {};
+  int source_first = 0;
+  int source_last = 0;
+  int destination_first = 0;
+  int destination_last = 0;
+  bool bidirectional = false;
+};
+
+class Relation {
+public:
+  typedef std::pair<int, int> int_pair_t;
+
+  void AddRange(int id, int_pair_t r1, int_pair_t r2);
+  bool FindRange(int episode_number, int_pair_t& result) const;
+
+  struct Range {
+    int id;
+    int_pair_t r0;
+    int_pair_t r1;
+  };
+  const std::vector<Range>& ranges() const;
+
+private:
+  // Source ranges sorted by their first episode. max_last is the largest last
+  // episode up to and including the interval, which tells us when to stop
+  // looking further back.
+  struct Interval {
+    int first;
+    int last;
+    int max_last;
+    unsigned int index;  // in ranges_
+  };
+
+  std::vector<Range> ranges_;  // in the order they were added
+  std::vector<Interval> intervals_;
+};
+
+// Rules are stored once with the IDs of every service, and indexed separately
+// for each service, so that switching services doesn't require parsing the
+// rules again.
+class RelationTable {
+public:
+  void AddRule(const RelationRule& rule);
+  const Relation* Find(size_t column, int id) const;
+
+  const std::vector<RelationRule>& rules() const;
+  void swap(RelationTable& other);
+
+private:
+  std::vector<RelationRule> rules_;
+  std::unordered_map<int, Relation> indexes_[kRelationServiceCount];
+};
+
+class SnapshotReader;
+class SnapshotWriter;
+
+// Hash table that maps normalized titles to anime IDs. Titles are stored back
+// to back in a single buffer, and IDs are stored inline unless a title belongs
+// to more than one anime. The index of an entry doesn't change until it is
+// erased.
+class TitleTable {
+public:
+  static constexpr unsigned int npos = static_cast<unsigned int>(-1);
+
+  bool Find(const std::wstring& title, std::set<int>& anime_ids) const;
+  // Returns the index of the entry, or npos if the ID was already there
+  unsigned int Insert(const std::wstring& title, int anime_id);
+  void Erase(unsigned int index, int anime_id);
+  bool HasEntry(unsigned int index) const;
+
+  bool Load(SnapshotReader& reader);
+  void Save(SnapshotWriter& writer) const;
+
+private:
+  struct Entry {
+    size_t hash = 0;
+    unsigned int offset = npos;  // in buffer_, or npos if the entry is free
+    unsigned int length = 0;
+    int anime_id = 0;
+    unsigned int list = 0;  // index + 1 in lists_, if there are more IDs
+  };
+
+  std::wstring_view GetTitle(const Entry& entry) const;
+  size_t FindSlot(std::wstring_view title, size_t hash) const;
+  void EraseSlot(size_t slot);
+  void Rehash(size_t slot_count);
+  void CompactBuffer();
+
+  std::wstring buffer_;
+  size_t garbage_ = 0;  // characters of erased titles in buffer_
+  std::vector<Entry> entries_;
+  std::vector<unsigned int> free_entries_;
+  std::vector<std::vector<int>> lists_;
+  std::vector<unsigned int> free_lists_;
+  std::vector<unsigned int> slots_;  // entry index + 1, or 0 if empty
+  size_t size_ = 0;
+};
+
+// Parsing and identification can be done from multiple threads at the same
+// time. Queries share a read lock on the title index and relations, and keep
+// their intermediate state (e.g. scores) to themselves. Updates wait for all
+// queries to finish.
+//
+// The database isn't locked. It is only modified on the main thread, which
+// doesn't run queries from other threads at the same time (e.g. IdentifyBatch
+// returns after its worker threads are done), so queries that read it from
+// other threads must be finished before it is modified.
 class Engine {
 public:
+  Engine();
+  // Titles are indexed from, and matches are validated against, the given
+  // database instead of the one that is loaded. Such an engine is detached
+  // from the application: it neither uses snapshots nor updates settings.
+  explicit Engine(anime::Database& database);
+
   bool Parse(std::wstring filename, const ParseOptions& parse_options, anime::Episode& episode) const;
-  int Identify(anime::Episode& episode, bool give_score, const MatchOptions& match_options);
-  bool Search(const std::wstring& title, std::vector<int>& anime_ids);
+  int Identify(anime::Episode& episode, bool give_score, const MatchOptions& match_options) const;
+  // Also gives the scores of the best candidates, which can't be cached, so
+  // the lookup is always done
+  int Identify(anime::Episode& episode, const MatchOptions& match_options, sorted_scores_t& scores) const;
+
+  // Batch versions of Parse and Identify, which spread the work over multiple
+  // threads. Results are the same as calling the single versions in order.
+  // The callback is called for each identified episode in order, on the
+  // calling thread, and can return true to stop.
+  typedef std::function<bool(size_t index)> batch_callback_t;
+  void ParseBatch(const std::vector<std::wstring>& filenames, const ParseOptions& parse_options, std::vector<anime::Episode>& episodes, std::vector<char>& results) const;
+  void IdentifyBatch(std::vector<anime::Episode>& episodes, const MatchOptions& match_options, batch_callback_t callback = nullptr) const;
+
+  bool Search(const std::wstring& title, std::vector<int>& anime_ids) const;
 
   void InitializeTitles();
+  void UpdateParserOptions();
   void UpdateTitles(const anime::Item& anime_item, bool erase_ids = false);
 
-  sorted_scores_t GetScores() const;
-
   bool IsBatchRelease(const anime::Episode& episode) const;
   bool IsValidAnimeType(const anime::Episode& episode) const;
   bool IsValidAnimeType(const std::wstring& path, const ParseOptions& parse_options) const;
@@ -70,9 +214,46 @@ public:
 
   bool ReadRelations();
   bool ReadRelations(const std::string& document);
-  bool SearchEpisodeRedirection(int id, const std::pair<int, int>& range, int& destination_id, std::pair<int, int>& destination_range) const;
+
+  struct CacheStats {
+    size_t hits = 0;
+    size_t misses = 0;
+  };
+  CacheStats GetCacheStats() const;
+  void InvalidateCache();
+  // Changes whenever the results of Parse or Identify may change, e.g. when
+  // parser options, titles or the database change
+  unsigned int GetGeneration() const;
+
+  // Counters for each stage of identification, which tell where the time goes
+  // and which heuristics succeed. They're disabled by default, in which case
+  // each stage costs a single check. Lookup times include validation.
+  enum Stage {
+    kStageMergedTitleLookup,
+    kStageTitleLookup,
+    kStageDirectoryLookup,
+    kStageValidation,
+    kStageRedirection,
+    kStageScoring,
+    kStageCount
+  };
+  struct StageStats {
+    UINT64 calls = 0;
+    UINT64 hits = 0;
+    UINT64 candidates = 0;
+    std::chrono::nanoseconds time{0};
+  };
+  typedef std::array<StageStats, kStageCount> stage_stats_t;
+  static const char* GetStageName(Stage stage);
+  void EnableStageStats(bool enable);
+  stage_stats_t GetStageStats() const;
+  void ResetStageStats();
+  void LogStageStats() const;
 
 private:
+  anime::Database& database_;
+  const bool detached_;
+
   enum NormalizationType {
     kNormalizeMinimal,
     kNormalizeForTrigrams,
@@ -83,25 +264,42 @@ private:
   bool ValidateOptions(anime::Episode& episode, int anime_id, const MatchOptions& match_options, bool redirect) const;
   bool ValidateOptions(anime::Episode& episode, const anime::Item& anime_item, const MatchOptions& match_options, bool redirect) const;
   bool ValidateEpisodeNumber(anime::Episode& episode, const anime::Item& anime_item, const MatchOptions& match_options, bool redirect) const;
+  bool SearchEpisodeRedirection(int id, const std::pair<int, int>& range, int& destination_id, std::pair<int, int>& destination_range) const;
+
+  // Parser options are built from the settings once, and then shared by the
+  // parsers of each thread until the settings change.
+  struct ParserOptions {
+    anitomy::Options file;
+    anitomy::Options streaming;
+  };
+  std::shared_ptr<const ParserOptions> GetParserOptions() const;
+  mutable std::shared_ptr<const ParserOptions> parser_options_;
+  mutable std::mutex parser_options_mutex_;
+  std::atomic<unsigned int> parser_options_generation_{1};
 
+  // Titles are indexed on the first query, before any query reads them
+  void InitializeTitlesOnce() const;
+  void IdentifyTitle(anime::Episode& episode, bool give_score, const MatchOptions& match_options, sorted_scores_t& scores) const;
+  void IdentifyTitleCached(anime::Episode& episode, const MatchOptions& match_options) const;
+  void PostProcess(anime::Episode& episode) const;
   int LookUpTitle(std::wstring title, std::set<int>& anime_ids) const;
-  bool GetTitleFromPath(anime::Episode& episode);
+  bool GetTitleFromPath(anime::Episode& episode) const;
   void ExtendAnimeTitle(anime::Episode& episode) const;
 
-  int ScoreTitle(anime::Episode& episode, const std::set<int>& anime_ids, const MatchOptions& match_options);
-  int ScoreTitle(const std::wstring& str, const anime::Episode& episode, const scores_t& trigram_results);
+  // Only the best scores are kept, or the ones that can be accepted as a match
+  // if give_score is false.
+  int ScoreTitle(anime::Episode& episode, const std::set<int>& anime_ids, const MatchOptions& match_options, bool give_score, sorted_scores_t& scores) const;
+  int ScoreTitle(const std::wstring& str, const anime::Episode& episode, const scores_t& trigram_results, bool give_score, sorted_scores_t& scores) const;
 
   void Normalize(std::wstring& title, int type, bool normalized_before) const;
   void NormalizeUnicode(std::wstring& str) const;
   void ErasePunctuation(std::wstring& str, int type, bool modified_tail) const;
-  void EraseUnnecessary(std::wstring& str) const;
-  void ConvertOrdinalNumbers(std::wstring& str) const;
   void ConvertRomanNumbers(std::wstring& str) const;
-  void ConvertSeasonNumbers(std::wstring& str) const;
+  void ReplaceKeywords(std::wstring& str) const;
   void Transliterate(std::wstring& str) const;
 
   struct Titles {
-    typedef std::map<std::wstring, std::set<int>> container_t;
+    typedef TitleTable container_t;
     container_t alternative;
     container_t main;
     container_t user;
@@ -110,9 +308,99 @@ private:
   struct ScoreStore {
     std::vector<std::wstring> normal_titles;
     std::vector<trigram_container_t> trigrams;
+    // Where the anime ID is inserted in the title tables, so that an item can
+    // be erased without going through every title
+    struct TitleKey {
+      Titles::container_t* titles;
+      unsigned int index;
+    };
+    std::vector<TitleKey> title_keys;
+  };
+  const ScoreStore* FindScoreStore(int anime_id) const;
+  ScoreStore* GetScoreStore(int anime_id);
+  std::vector<ScoreStore> db_;
+  std::vector<unsigned int> db_index_;  // anime ID -> index + 1 in db_
+
+  // Inverted index that maps each trigram to the titles that contain it, so
+  // that we only need to score the titles that share trigrams with the query.
+  struct TrigramPosting {
+    int anime_id;
+    unsigned short title_index;
+    unsigned short count;
+  };
+  void AddTrigramPostings(int anime_id);
+  void EraseTrigramPostings(int anime_id);
+  void GetTrigramResults(const trigram_container_t& trigrams,
+                         scores_t& trigram_results) const;
+  std::unordered_map<trigram_t, std::vector<TrigramPosting>> trigram_index_;
+
+  // Relation rules, for snapshots. Must be called with mutex_ held.
+  void ExportRelations(std::vector<RelationRule>& rules) const;
+  void ImportRelations(const std::vector<RelationRule>& rules);
+
+  // Snapshot of the title index and relations, so that we don't have to build
+  // them from scratch on every startup. The checksum covers everything that
+  // the index is built from.
+  UINT64 GetSnapshotChecksum() const;
+  bool LoadSnapshot(UINT64 checksum);
+  void SaveSnapshot(UINT64 checksum) const;
+  const TitleTable* GetTitleTable(size_t index) const;
+  TitleTable* GetTitleTable(size_t index);
+  size_t GetTitleTableIndex(const TitleTable* table) const;
+
+  // Adds the time since construction to the stage, if stats are enabled
+  class StageTimer {
+  public:
+    StageTimer(const Engine& engine, Stage stage);
+    ~StageTimer();
+    void AddCandidates(size_t count);
+    void Hit();
+
+  private:
+    const Engine& engine_;
+    const Stage stage_;
+    const bool enabled_;
+    std::chrono::steady_clock::time_point t0_;
+  };
+
+  struct StageCounters {
+    std::atomic<UINT64> calls{0};
+    std::atomic<UINT64> hits{0};
+    std::atomic<UINT64> candidates{0};
+    std::atomic<UINT64> nanoseconds{0};
+  };
+  mutable std::array<StageCounters, kStageCount> stage_counters_;
+  std::atomic<bool> stage_stats_enabled_{false};
+
+  // Episode redirections, which each engine reads for itself
+  RelationTable relations_;
+
+  // Guards titles and relations
+  mutable std::shared_mutex mutex_;
+  std::once_flag initialized_;
+
+  // Identification results, invalidated by bumping the generation whenever
+  // titles, relations or the database change
+  std::wstring GetCacheKey(const anime::Episode& episode, const MatchOptions& match_options) const;
+  bool FindCachedResult(const std::wstring& key, anime::Episode& episode, unsigned int& generation) const;
+  void AddCachedResult(const std::wstring& key, const anime::Episode& episode, unsigned int generation) const;
+  void CheckCacheDate() const;
+
+  struct Cache {
+    using clock_t = std::chrono::steady_clock;
+    struct Entry {
+      anime::Episode episode;
+      unsigned int generation;
+      clock_t::time_point time;
+    };
+    std::unordered_map<std::wstring, Entry> entries;
+    std::deque<std::wstring> keys;  // in insertion order
+    unsigned int generation = 0;
+    Date date;  // in Japan, when the generation was last checked
+    CacheStats stats;
   };
-  std::map<int, ScoreStore> db_;
-  sorted_scores_t scores_;
+  mutable Cache cache_;
+  mutable std::mutex cache_mutex_;
 };
 
 }  // namespace recognition
@@ -0,0 +1,138 @@
+/*
+** Taiga
+** Copyright (C) 2010-2018, Eren Okka
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "base/string.h"
+#include "base/time.h"
+#include "taiga/settings.h"
+#include "track/recognition.h"
+
+namespace track {
+namespace recognition {
+
+constexpr size_t kMaxCacheSize = 1000;
+
+// Validation also depends on airing dates, which are checked against the date
+// in Japan (see CheckCacheDate). Entries expire after a while as well, in case
+// airing dates change in the database without the titles being updated.
+constexpr auto kCacheLifetime = std::chrono::hours(1);
+
+Engine::CacheStats Engine::GetCacheStats() const {
+  std::lock_guard<std::mutex> lock(cache_mutex_);
+  return cache_.stats;
+}
+
+void Engine::InvalidateCache() {
+  std::lock_guard<std::mutex> lock(cache_mutex_);
+  ++cache_.generation;
+}
+
+unsigned int Engine::GetGeneration() const {
+  std::lock_guard<std::mutex> lock(cache_mutex_);
+  CheckCacheDate();
+  return cache_.generation + parser_options_generation_;
+}
+
+std::wstring Engine::GetCacheKey(const anime::Episode& episode,
+                                 const MatchOptions& match_options) const {
+  std::wstring key;
+
+  const bool options[] = {
+    match_options.allow_sequels,
+    match_options.check_airing_date,
+    match_options.check_anime_type,
+    match_options.check_episode_number,
+    match_options.streaming_media,
+    Settings.GetBool(taiga::kRecognition_LookupParentDirectories),
+  };
+  for (const auto option : options)
+    key.push_back(option ? L'1' : L'0');
+
+  // Control characters can't appear in parsed elements, so they're safe to use
+  // as separators.
+  key += ToWstr(episode.anime_id) + L'\x1F';
+  key += episode.folder + L'\x1F';
+  for (const auto& element : episode.elements()) {
+    key += ToWstr(static_cast<int>(element.first)) + L'\x1E';
+    key += element.second + L'\x1F';
+  }
+
+  return key;
+}
+
+bool Engine::FindCachedResult(const std::wstring& key,
+                              anime::Episode& episode,
+                              unsigned int& generation) const {
+  std::lock_guard<std::mutex> lock(cache_mutex_);
+
+  // The result is computed without holding the lock, so it is tagged with the
+  // generation at the time of the lookup. If the titles change in the meantime,
+  // the new entry is going to be stale from the start.
+  CheckCacheDate();
+  generation = cache_.generation;
+
+  auto it = cache_.entries.find(key);
+
+  if (it == cache_.entries.end() ||
+      it->second.generation != cache_.generation ||
+      Cache::clock_t::now() - it->second.time > kCacheLifetime) {
+    ++cache_.stats.misses;
+    return false;
+  }
+
+  const bool processed = episode.processed;
+  episode = it->second.episode;
+  episode.processed = processed;
+
+  ++cache_.stats.hits;
+  return true;
+}
+
+void Engine::AddCachedResult(const std::wstring& key,
+                             const anime::Episode& episode,
+                             unsigned int generation) const {
+  std::lock_guard<std::mutex> lock(cache_mutex_);
+
+  auto it = cache_.entries.find(key);
+
+  // Replace the stale entry in place, keeping its position in the queue
+  if (it != cache_.entries.end()) {
+    it->second = {episode, generation, Cache::clock_t::now()};
+    return;
+  }
+
+  if (cache_.entries.size() >= kMaxCacheSize) {
+    cache_.entries.erase(cache_.keys.front());
+    cache_.keys.pop_front();
+  }
+
+  cache_.entries.insert({key, {episode, generation, Cache::clock_t::now()}});
+  cache_.keys.push_back(key);
+}
+
+// A title that hasn't aired yet is rejected when airing dates are checked, and
+// the result must not outlive the day. Must be called with cache_mutex_ held.
+void Engine::CheckCacheDate() const {
+  const auto date = GetDateJapan();
+  if (date != cache_.date) {
+    cache_.date = date;
+    ++cache_.generation;
+  }
+}
+
+}  // namespace recognition
+}  // namespace track
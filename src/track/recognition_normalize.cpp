@@ -17,6 +17,10 @@
 */
 
 #include <algorithm>
+#include <cassert>
+#include <map>
+#include <queue>
+#include <unordered_map>
 
 #include <utf8proc/utf8proc.h>
 
@@ -25,6 +29,112 @@
 namespace track {
 namespace recognition {
 
+// Applies a list of whole-word replacements, giving the same result as calling
+// ReplaceString for each rule in order. All patterns are searched at once with
+// an Aho-Corasick automaton, and only the rules with a pattern that occurs in
+// the string are applied. Most titles don't contain any pattern, so they are
+// left alone after a single scan.
+class ReplacementTable {
+public:
+  struct Rule {
+    std::wstring find;
+    std::wstring replace;
+  };
+
+  explicit ReplacementTable(const std::vector<Rule>& rules);
+
+  void Apply(std::wstring& str) const;
+
+private:
+  typedef unsigned long long mask_t;
+
+  mask_t Find(const std::wstring& str) const;
+
+  struct Node {
+    std::map<wchar_t, size_t> next;
+    size_t fail = 0;
+    mask_t output = 0;
+  };
+
+  std::vector<Node> nodes_;
+  std::vector<Rule> rules_;
+};
+
+ReplacementTable::ReplacementTable(const std::vector<Rule>& rules)
+    : nodes_(1), rules_(rules) {
+  assert(rules_.size() <= sizeof(mask_t) * 8);
+
+  // Build the trie
+  for (size_t i = 0; i < rules_.size(); ++i) {
+    size_t node = 0;
+    for (const auto c : rules_[i].find) {
+      auto it = nodes_[node].next.find(c);
+      if (it == nodes_[node].next.end()) {
+        nodes_[node].next[c] = nodes_.size();
+        node = nodes_.size();
+        nodes_.emplace_back();
+      } else {
+        node = it->second;
+      }
+    }
+    nodes_[node].output |= static_cast<mask_t>(1) << i;
+  }
+
+  // Set failure links in breadth-first order, so that the outputs of shorter
+  // suffixes are merged before they're needed
+  std::queue<size_t> queue;
+  for (const auto& it : nodes_[0].next)
+    queue.push(it.second);
+
+  while (!queue.empty()) {
+    const size_t node = queue.front();
+    queue.pop();
+    for (const auto& it : nodes_[node].next) {
+      size_t fail = nodes_[node].fail;
+      while (fail && !nodes_[fail].next.count(it.first))
+        fail = nodes_[fail].fail;
+      auto target = nodes_[fail].next.find(it.first);
+      if (target != nodes_[fail].next.end() && target->second != it.second)
+        fail = target->second;
+      nodes_[it.second].fail = fail;
+      nodes_[it.second].output |= nodes_[fail].output;
+      queue.push(it.second);
+    }
+  }
+}
+
+ReplacementTable::mask_t ReplacementTable::Find(const std::wstring& str) const {
+  mask_t found = 0;
+  size_t node = 0;
+
+  for (const auto c : str) {
+    auto it = nodes_[node].next.find(c);
+    while (node && it == nodes_[node].next.end()) {
+      node = nodes_[node].fail;
+      it = nodes_[node].next.find(c);
+    }
+    node = it != nodes_[node].next.end() ? it->second : 0;
+    found |= nodes_[node].output;
+  }
+
+  return found;
+}
+
+void ReplacementTable::Apply(std::wstring& str) const {
+  mask_t found = Find(str);
+
+  for (size_t i = 0; found && i < rules_.size(); ++i) {
+    if (found & (static_cast<mask_t>(1) << i)) {
+      const auto& rule = rules_[i];
+      // Replacements may create or remove occurrences of other patterns
+      if (ReplaceString(str, 0, rule.find, rule.replace, true, true))
+        found = Find(str);
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 void Engine::Normalize(std::wstring& title, int type,
                        bool normalized_before) const {
   bool modified_tail = false;
@@ -35,9 +145,7 @@ void Engine::Normalize(std::wstring& title, int type,
     ConvertRomanNumbers(title);
     Transliterate(title);
     NormalizeUnicode(title);  // Title is lower case after this point, due to UTF8PROC_CASEFOLD
-    ConvertOrdinalNumbers(title);
-    ConvertSeasonNumbers(title);
-    EraseUnnecessary(title);
+    ReplaceKeywords(title);
     Trim(title);
 
     if (title.size() != unmodified_title.size() &&
@@ -56,21 +164,46 @@ void Engine::Normalize(std::wstring& title, int type,
       break;
   }
 
-  if (type < kNormalizeFull)
-    while (ReplaceString(title, 0, L"  ", L" ", false, true));
+  // Collapse consecutive spaces
+  if (type < kNormalizeFull) {
+    title.erase(std::unique(title.begin(), title.end(),
+                            [](const wchar_t a, const wchar_t b) {
+                              return a == L' ' && b == L' ';
+                            }),
+                title.end());
+  }
 }
 
 /////////////////////////////////////////////////////////////////////////////////
 
-void Engine::ConvertOrdinalNumbers(std::wstring& str) const {
-  static const std::vector<std::pair<std::wstring, std::wstring>> ordinals{
-    {L"1st", L"first"}, {L"2nd", L"second"}, {L"3rd", L"third"},
-    {L"4th", L"fourth"}, {L"5th", L"fifth"}, {L"6th", L"sixth"},
-    {L"7th", L"seventh"}, {L"8th", L"eighth"}, {L"9th", L"ninth"},
-  };
-
-  for (const auto& ordinal : ordinals)
-    ReplaceString(str, 0, ordinal.second, ordinal.first, true, true);
+void Engine::ReplaceKeywords(std::wstring& str) const {
+  // Ordinal numbers are converted first, so that the season rules below can
+  // match e.g. "second season".
+  static const ReplacementTable table({
+    // Ordinal numbers
+    {L"first", L"1st"}, {L"second", L"2nd"}, {L"third", L"3rd"},
+    {L"fourth", L"4th"}, {L"fifth", L"5th"}, {L"sixth", L"6th"},
+    {L"seventh", L"7th"}, {L"eighth", L"8th"}, {L"ninth", L"9th"},
+    // Season numbers
+    {L"1st season", L"1"}, {L"season 1", L"1"}, {L"series 1", L"1"}, {L"s1", L"1"},
+    {L"2nd season", L"2"}, {L"season 2", L"2"}, {L"series 2", L"2"}, {L"s2", L"2"},
+    {L"3rd season", L"3"}, {L"season 3", L"3"}, {L"series 3", L"3"}, {L"s3", L"3"},
+    {L"4th season", L"4"}, {L"season 4", L"4"}, {L"series 4", L"4"}, {L"s4", L"4"},
+    {L"5th season", L"5"}, {L"season 5", L"5"}, {L"series 5", L"5"}, {L"s5", L"5"},
+    {L"6th season", L"6"}, {L"season 6", L"6"}, {L"series 6", L"6"}, {L"s6", L"6"},
+    // Unnecessary words
+    {L"&", L"and"},
+    {L"the animation", L""},
+    {L"the", L""},
+    {L"episode", L""},
+    {L"oad", L"ova"},
+    {L"oav", L"ova"},
+    {L"specials", L"sp"},
+    {L"special", L"sp"},
+    {L"(tv)", L""},
+  });
+
+  table.Apply(str);
 }
 
 void Engine::ConvertRomanNumbers(std::wstring& str) const {
@@ -78,31 +211,13 @@ void Engine::ConvertRomanNumbers(std::wstring& str) const {
   // used as Roman numerals. Any number above "XIII" is rarely used in anime
   // titles, which is why we don't need an actual Roman-to-Arabic number
   // conversion algorithm.
-  static const std::vector<std::pair<std::wstring, std::wstring>> numerals{
-    {L"2", L"II"}, {L"3", L"III"}, {L"4", L"IV"}, {L"5", L"V"},
-    {L"6", L"VI"}, {L"7", L"VII"}, {L"8", L"VIII"}, {L"9", L"IX"},
-    {L"11", L"XI"}, {L"12", L"XII"}, {L"13", L"XIII"},
-  };
+  static const ReplacementTable table({
+    {L"II", L"2"}, {L"III", L"3"}, {L"IV", L"4"}, {L"V", L"5"},
+    {L"VI", L"6"}, {L"VII", L"7"}, {L"VIII", L"8"}, {L"IX", L"9"},
+    {L"XI", L"11"}, {L"XII", L"12"}, {L"XIII", L"13"},
+  });
 
-  for (const auto& numeral : numerals)
-    ReplaceString(str, 0, numeral.second, numeral.first, true, true);
-}
-
-void Engine::ConvertSeasonNumbers(std::wstring& str) const {
-  // This works considerably faster than regular expressions.
-  typedef std::vector<std::wstring> season_t;
-  static const std::vector<std::pair<std::wstring, season_t>> values{
-    {L"1", {L"1st season", L"season 1", L"series 1", L"s1"}},
-    {L"2", {L"2nd season", L"season 2", L"series 2", L"s2"}},
-    {L"3", {L"3rd season", L"season 3", L"series 3", L"s3"}},
-    {L"4", {L"4th season", L"season 4", L"series 4", L"s4"}},
-    {L"5", {L"5th season", L"season 5", L"series 5", L"s5"}},
-    {L"6", {L"6th season", L"season 6", L"series 6", L"s6"}},
-  };
-
-  for (const auto& value : values)
-    for (const auto& season : value.second)
-      ReplaceString(str, 0, season, value.first, true, true);
+  table.Apply(str);
 }
 
 void Engine::Transliterate(std::wstring& str) const {
@@ -121,51 +236,158 @@ void Engine::Transliterate(std::wstring& str) const {
   }
 
   // Romanizations (Hepburn to Wapuro)
-  ReplaceString(str, 0, L"wa", L"ha", true, true);
-  ReplaceString(str, 0, L"e", L"he", true, true);
-  ReplaceString(str, 0, L"o", L"wo", true, true);
-}
+  static const ReplacementTable table({
+    {L"wa", L"ha"},
+    {L"e", L"he"},
+    {L"o", L"wo"},
+  });
 
-void Engine::NormalizeUnicode(std::wstring& str) const {
-  static const int options =
-      // NFKC normalization according to Unicode Standard Annex #15
-      UTF8PROC_COMPAT | UTF8PROC_COMPOSE | UTF8PROC_STABLE |
-      // Strip "default ignorable" characters, control characters, character
-      // marks (accents, diaeresis)
-      UTF8PROC_IGNORE | UTF8PROC_STRIPCC | UTF8PROC_STRIPMARK |
-      // Map certain characters (e.g. hyphen and minus) for easier comparison
-      UTF8PROC_LUMP |
-      // Perform unicode case folding for case-insensitive comparison
-      UTF8PROC_CASEFOLD;
+  table.Apply(str);
+}
 
+static const utf8proc_option_t kUnicodeOptions = static_cast<utf8proc_option_t>(
+    // NFKC normalization according to Unicode Standard Annex #15
+    UTF8PROC_COMPAT | UTF8PROC_COMPOSE | UTF8PROC_STABLE |
+    // Strip "default ignorable" characters, control characters, character
+    // marks (accents, diaeresis)
+    UTF8PROC_IGNORE | UTF8PROC_STRIPCC | UTF8PROC_STRIPMARK |
+    // Map certain characters (e.g. hyphen and minus) for easier comparison
+    UTF8PROC_LUMP |
+    // Perform unicode case folding for case-insensitive comparison
+    UTF8PROC_CASEFOLD);
+
+static bool MapUnicode(std::string& str) {
   char* buffer = nullptr;
-  std::string temp = WstrToStr(str);
 
   int length = utf8proc_map(
-      reinterpret_cast<const utf8proc_uint8_t*>(temp.data()), temp.length(),
-      reinterpret_cast<utf8proc_uint8_t**>(&buffer),
-      static_cast<utf8proc_option_t>(options));
+      reinterpret_cast<const utf8proc_uint8_t*>(str.data()), str.length(),
+      reinterpret_cast<utf8proc_uint8_t**>(&buffer), kUnicodeOptions);
 
-  if (length >= 0) {
-    temp.assign(buffer, length);
-    str = StrToWstr(temp);
-  }
+  if (length >= 0)
+    str.assign(buffer, length);
 
   if (buffer)
     free(buffer);
+
+  return length >= 0;
 }
 
-// TODO: Rename
-void Engine::EraseUnnecessary(std::wstring& str) const {
-  ReplaceString(str, 0, L"&", L"and", true, true);
-  ReplaceString(str, 0, L"the animation", L"", true, true);
-  ReplaceString(str, 0, L"the", L"", true, true);
-  ReplaceString(str, 0, L"episode", L"", true, true);
-  ReplaceString(str, 0, L"oad", L"ova", true, true);
-  ReplaceString(str, 0, L"oav", L"ova", true, true);
-  ReplaceString(str, 0, L"specials", L"sp", true, true);
-  ReplaceString(str, 0, L"special", L"sp", true, true);
-  ReplaceString(str, 0, L"(tv)", L"", true, true);
+// Results of utf8proc_map for each character in the Basic Multilingual Plane,
+// so that most titles can be normalized without converting to UTF-8 and back.
+// Characters that may interact with their neighbors (i.e. control characters
+// that are merged as line breaks, Hangul jamo that are composed into
+// syllables, and non-starters that are reordered) are left out of the table.
+class UnicodeTable {
+public:
+  UnicodeTable();
+
+  // Returns false if the string contains characters that are not in the table
+  bool Map(std::wstring& str) const;
+
+private:
+  enum Kind : unsigned char {
+    kUnavailable,
+    kEmpty,
+    kSingle,
+    kSequence,
+  };
+
+  std::vector<Kind> kinds_;
+  std::vector<wchar_t> chars_;
+  std::unordered_map<wchar_t, std::wstring> sequences_;
+};
+
+UnicodeTable::UnicodeTable()
+    : kinds_(0x10000, kUnavailable), chars_(0x10000, L'\0') {
+  auto is_available = [](const std::wstring& str) {
+    for (const auto c : str) {
+      if ((c >= 0x1100 && c <= 0x11FF) ||  // Hangul jamo
+          (c >= 0x3130 && c <= 0x318F) ||  // Hangul compatibility jamo
+          (c >= 0xA960 && c <= 0xA97F) ||  // Hangul jamo extended-A
+          (c >= 0xAC00 && c <= 0xDFFF))    // Hangul syllables and surrogates
+        return false;
+      if (utf8proc_get_property(c)->combining_class != 0)
+        return false;
+    }
+    return true;
+  };
+
+  for (size_t i = 0x20; i < 0x10000; ++i) {
+    const wchar_t c = static_cast<wchar_t>(i);
+    if ((c >= 0x7F && c <= 0x9F) || (c >= 0xD800 && c <= 0xDFFF))
+      continue;  // Control characters and surrogates
+
+    std::string str = WstrToStr(std::wstring(1, c));
+    if (!MapUnicode(str))
+      continue;
+    const std::wstring result = StrToWstr(str);
+    if (!is_available(std::wstring(1, c)) || !is_available(result))
+      continue;
+
+    switch (result.size()) {
+      case 0:
+        kinds_[c] = kEmpty;
+        break;
+      case 1:
+        kinds_[c] = kSingle;
+        chars_[c] = result.front();
+        break;
+      default:
+        kinds_[c] = kSequence;
+        sequences_[c] = result;
+        break;
+    }
+  }
+}
+
+bool UnicodeTable::Map(std::wstring& str) const {
+  // wchar_t is wider than a UTF-16 code unit on some platforms
+  for (const auto c : str)
+    if (static_cast<size_t>(c) >= kinds_.size() || kinds_[c] == kUnavailable)
+      return false;
+
+  // Most characters map to at most one character, so we can work in place
+  size_t i = 0;
+  size_t length = 0;
+  for (; i < str.size(); ++i) {
+    const wchar_t c = str[i];
+    if (kinds_[c] == kSequence)
+      break;
+    if (kinds_[c] == kSingle)
+      str[length++] = chars_[c];
+  }
+
+  if (i == str.size()) {
+    str.resize(length);
+    return true;
+  }
+
+  std::wstring output(str, 0, length);
+  for (; i < str.size(); ++i) {
+    const wchar_t c = str[i];
+    switch (kinds_[c]) {
+      case kSingle:
+        output.push_back(chars_[c]);
+        break;
+      case kSequence:
+        output.append(sequences_.at(c));
+        break;
+    }
+  }
+  str.swap(output);
+
+  return true;
+}
+
+void Engine::NormalizeUnicode(std::wstring& str) const {
+  static const UnicodeTable table;
+
+  if (table.Map(str))
+    return;
+
+  std::string temp = WstrToStr(str);
+  if (MapUnicode(temp))
+    str = StrToWstr(temp);
 }
 
 void Engine::ErasePunctuation(std::wstring& str, int type,
@@ -16,135 +16,290 @@
 ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include <regex>
+#include <algorithm>
+#include <climits>
+#include <string_view>
+#include <unordered_map>
 
 #include <semaver/src/semaver.hpp>
 
 #include "base/file.h"
-#include "base/format.h"
 #include "base/log.h"
 #include "sync/service.h"
 #include "taiga/path.h"
 #include "taiga/settings.h"
-#include "taiga/taiga.h"
+#include "taiga/version.h"
 #include "track/recognition.h"
 
 namespace track {
 namespace recognition {
 
-class Relation {
-public:
-  typedef std::pair<int, int> int_pair_t;
+constexpr size_t kMaxLinearRanges = 128;
 
-  void AddRange(int id, int_pair_t r1, int_pair_t r2);
-  bool FindRange(int episode_number, int_pair_t& result) const;
+////////////////////////////////////////////////////////////////////////////////
+
+void Relation::AddRange(int id, int_pair_t r1, int_pair_t r2) {
+  const auto index = static_cast<unsigned int>(ranges_.size());
+  ranges_.push_back({id, r1, r2});
 
-private:
-  struct Range {
-    int id;
-    int_pair_t r0;
-    int_pair_t r1;
+  auto it = std::upper_bound(intervals_.begin(), intervals_.end(), r1.first,
+      [](int first, const Interval& interval) {
+        return first < interval.first;
+      });
+  it = intervals_.insert(it, {r1.first, r1.second, r1.second, index});
+
+  int max_last = it == intervals_.begin() ? INT_MIN : std::prev(it)->max_last;
+  for (; it != intervals_.end(); ++it) {
+    max_last = std::max(max_last, it->last);
+    it->max_last = max_last;
+  }
+}
+
+const std::vector<Relation::Range>& Relation::ranges() const {
+  return ranges_;
+}
+
+bool Relation::FindRange(int episode_number, int_pair_t& result) const {
+  auto find_destination = [&](const Range& range) {
+    int destination = range.r1.first;
+    if (range.r1.first != range.r1.second)
+      destination += episode_number - range.r0.first;
+    if (destination <= range.r1.second) {
+      result.first = range.id;
+      result.second = destination;
+      return true;
+    }
+    return false;
   };
 
-  std::vector<Range> ranges_;
-};
+  // Most titles have only a few ranges, which are faster to scan in order
+  if (ranges_.size() <= kMaxLinearRanges) {
+    for (const auto& range : ranges_) {
+      if (episode_number - range.r0.first >= 0 &&
+          range.r0.second - episode_number >= 0 &&
+          find_destination(range))
+        return true;
+    }
+    return false;
+  }
+
+  // Only the intervals that start before the episode can contain it. If
+  // several of them match, the range that was added first wins.
+  auto it = std::upper_bound(intervals_.begin(), intervals_.end(),
+      episode_number,
+      [](int episode_number, const Interval& interval) {
+        return episode_number < interval.first;
+      });
+
+  unsigned int found_index = static_cast<unsigned int>(ranges_.size());
+
+  while (it != intervals_.begin()) {
+    --it;
+    if (it->max_last - episode_number < 0)
+      break;
+    if (it->last - episode_number < 0 || it->index > found_index)
+      continue;
+    if (find_destination(ranges_[it->index]))
+      found_index = it->index;
+  }
 
-std::map<int, Relation> relations;
+  return found_index < ranges_.size();
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void Relation::AddRange(int id, int_pair_t r1, int_pair_t r2) {
-  ranges_.push_back({id, r1, r2});
+void RelationTable::AddRule(const RelationRule& rule) {
+  rules_.push_back(rule);
+
+  const Relation::int_pair_t r0{rule.source_first, rule.source_last};
+  const Relation::int_pair_t r1{rule.destination_first, rule.destination_last};
+
+  for (size_t column = 0; column < kRelationServiceCount; ++column) {
+    const int id0 = rule.source_ids[column];
+    if (!id0)
+      continue;
+    const int id1 = rule.destination_ids[column] ?
+        rule.destination_ids[column] : id0;
+
+    auto& index = indexes_[column];
+    index[id0].AddRange(id1, r0, r1);
+    if (rule.bidirectional)
+      index[id1].AddRange(id1, r0, r1);
+  }
 }
 
-bool Relation::FindRange(int episode_number, int_pair_t& result) const {
-  for (const auto& it : ranges_) {
-    int distance = episode_number - it.r0.first;
-    if (distance >= 0) {
-      if (it.r0.second - episode_number >= 0) {
-        int destination = it.r1.first;
-        if (it.r1.first != it.r1.second)
-          destination += distance;
-        if (destination <= it.r1.second) {
-          result.first = it.id;
-          result.second = destination;
-          return true;
-        }
-      }
-    }
+const Relation* RelationTable::Find(size_t column, int id) const {
+  if (column >= kRelationServiceCount)
+    return nullptr;
+
+  const auto it = indexes_[column].find(id);
+  return it != indexes_[column].end() ? &it->second : nullptr;
+}
+
+const std::vector<RelationRule>& RelationTable::rules() const {
+  return rules_;
+}
+
+void RelationTable::swap(RelationTable& other) {
+  rules_.swap(other.rules_);
+  for (size_t column = 0; column < kRelationServiceCount; ++column) {
+    indexes_[column].swap(other.indexes_[column]);
   }
+}
 
-  return false;
+// IDs are listed for each service, in this order
+static size_t GetServiceColumn(sync::ServiceId service_id) {
+  switch (service_id) {
+    case sync::kMyAnimeList: return 0;
+    case sync::kKitsu: return 1;
+    case sync::kAniList: return 2;
+    default: return kRelationServiceCount;
+  }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static bool ParseRule(const std::wstring& rule) {
-  constexpr auto id_pattern = L"((?:\\d+|[?~])(?:\\|(?:\\d+|[?~]))*)";
-  constexpr auto episode_pattern = L"(\\d+)(?:-(\\d+|\\?))?";
-  static const std::wregex pattern(
-      L"{0}:{1} -> {0}:{1}(!)?"_format(id_pattern, episode_pattern));
+// Rules are plain ASCII, so we parse the UTF-8 document as it is, without
+// converting it or matching it against regular expressions.
 
-  std::match_results<std::wstring::const_iterator> match_results;
+static bool IsDigit(char c) {
+  return c >= '0' && c <= '9';
+}
 
-  if (!std::regex_match(rule, match_results, pattern))
+static bool Consume(std::string_view& str, std::string_view prefix) {
+  if (str.substr(0, prefix.size()) != prefix)
     return false;
+  str.remove_prefix(prefix.size());
+  return true;
+}
 
-  auto get_id = [&](size_t index) {
-    std::vector<std::wstring> ids;
-    Split(match_results[index].str(), L"|", ids);
-    switch (taiga::GetCurrentServiceId()) {
-      case sync::kMyAnimeList:
-        return ids.size() > 0 ? ToInt(ids.at(0)) : 0;
-      case sync::kKitsu:
-        return ids.size() > 1 ? ToInt(ids.at(1)) : 0;
-      case sync::kAniList:
-        return ids.size() > 2 ? ToInt(ids.at(2)) : 0;
-      default:
-        return 0;
-    }
-  };
+static std::string_view Trim(std::string_view str, std::string_view chars) {
+  const auto begin = str.find_first_not_of(chars);
+  if (begin == str.npos)
+    return {};
+  const auto end = str.find_last_not_of(chars);
+  return str.substr(begin, end - begin + 1);
+}
 
-  auto get_range = [&](size_t first, size_t second) {
-    std::pair<int, int> range;
-    range.first = ToInt(match_results[first].str());
-    if (match_results[second].matched) {
-      if (IsNumericString(match_results[second].str())) {
-        range.second = ToInt(match_results[second].str());
-      } else {
-        range.second = INT_MAX;
-      }
-    } else {
-      range.second = range.first;
-    }
-    return range;
-  };
+static std::string_view TrimLeft(std::string_view str,
+                                 std::string_view chars) {
+  const auto begin = str.find_first_not_of(chars);
+  return begin == str.npos ? std::string_view{} : str.substr(begin);
+}
 
-  const int id0 = get_id(1);
-  if (id0) {
-    const auto r0 = get_range(2, 3);
+// Saturates on overflow, like ToInt does
+static bool ParseNumber(std::string_view& str, int& value) {
+  if (str.empty() || !IsDigit(str.front()))
+    return false;
 
-    int id1 = get_id(4);
-    if (!id1)
-      id1 = id0;
-    const auto r1 = get_range(5, 6);
+  long long number = 0;
+  while (!str.empty() && IsDigit(str.front())) {
+    number = std::min<long long>(number * 10 + (str.front() - '0'), INT_MAX);
+    str.remove_prefix(1);
+  }
+
+  value = static_cast<int>(number);
+  return true;
+}
 
-    relations[id0].AddRange(id1, r0, r1);
+// e.g. "10|20|30", where "?" and "~" stand for unknown IDs
+static bool ParseIds(std::string_view& str, int (&ids)[kRelationServiceCount]) {
+  std::fill(std::begin(ids), std::end(ids), 0);
 
-    if (match_results[7].matched)
-      relations[id1].AddRange(id1, r0, r1);
+  for (size_t column = 0; ; ++column) {
+    int value = 0;
+    if (!Consume(str, "?") && !Consume(str, "~") && !ParseNumber(str, value))
+      return false;
+    if (column < kRelationServiceCount)
+      ids[column] = value;
+    if (!Consume(str, "|"))
+      return true;
+  }
+}
+
+// e.g. "1", "1-12" or "13-?"
+static bool ParseEpisodes(std::string_view& str, std::pair<int, int>& range) {
+  if (!ParseNumber(str, range.first))
+    return false;
+
+  range.second = range.first;
+
+  if (Consume(str, "-")) {
+    if (Consume(str, "?")) {
+      range.second = INT_MAX;
+    } else if (!ParseNumber(str, range.second)) {
+      return false;
+    }
   }
 
   return true;
 }
 
+// e.g. "10|20|30:1-12 -> 11|21|31:1-12!"
+static bool ParseRule(std::string_view str, RelationTable& relations) {
+  RelationRule rule;
+  std::pair<int, int> r0;
+  std::pair<int, int> r1;
+
+  if (!ParseIds(str, rule.source_ids) || !Consume(str, ":") ||
+      !ParseEpisodes(str, r0) || !Consume(str, " -> ") ||
+      !ParseIds(str, rule.destination_ids) || !Consume(str, ":") ||
+      !ParseEpisodes(str, r1))
+    return false;
+
+  rule.bidirectional = Consume(str, "!");
+
+  if (!str.empty())
+    return false;
+
+  rule.source_first = r0.first;
+  rule.source_last = r0.second;
+  rule.destination_first = r1.first;
+  rule.destination_last = r1.second;
+
+  relations.AddRule(rule);
+
+  return true;
+}
+
+// e.g. "version: 1.3.0"
+static bool ParseMeta(std::string_view line, std::string_view& name,
+                      std::string_view& value) {
+  const auto pos = line.find_first_not_of("abcdefghijklmnopqrstuvwxyz_");
+  if (pos == 0 || pos == line.npos)
+    return false;
+
+  name = line.substr(0, pos);
+  line.remove_prefix(pos);
+
+  if (!Consume(line, ": ") || line.empty())
+    return false;
+
+  value = line;
+  return true;
+}
+
+// Same as the one that the application reports, without depending on it
+static const semaver::Version& GetApplicationVersion() {
+  static const semaver::Version version = [] {
+    semaver::Version version;
+    version.major = TAIGA_VERSION_MAJOR;
+    version.minor = TAIGA_VERSION_MINOR;
+    version.patch = TAIGA_VERSION_PATCH;
+    version.prerelease = TAIGA_VERSION_PRE;
+    return version;
+  }();
+  return version;
+}
+
 bool Engine::ReadRelations() {
   std::wstring path = taiga::GetPath(taiga::Path::DatabaseAnimeRelations);
   std::string document;
 
   if (!ReadFromFile(path, document)) {
     LOGW(L"Could not read anime relations data.");
-    Settings.Set(taiga::kRecognition_RelationsLastModified, std::wstring());
+    if (!detached_)
+      Settings.Set(taiga::kRecognition_RelationsLastModified, std::wstring());
     return false;
   }
 
@@ -152,10 +307,9 @@ bool Engine::ReadRelations() {
 }
 
 bool Engine::ReadRelations(const std::string& document) {
-  relations.clear();
-
-  std::vector<std::wstring> lines;
-  Split(StrToWstr(document), L"\n", lines);
+  // Rules are parsed into a new container, so that queries can continue while
+  // we're parsing.
+  RelationTable new_relations;
 
   enum class FileSection {
     Unknown,
@@ -164,19 +318,22 @@ bool Engine::ReadRelations(const std::string& document) {
   };
   auto current_section = FileSection::Unknown;
 
-  for (auto& line : lines) {
-    Trim(line, L"\r ");
+  std::string_view lines = document;
+
+  while (!lines.empty()) {
+    const auto pos = lines.find('\n');
+    auto line = Trim(lines.substr(0, pos), "\r ");
+    lines.remove_prefix(pos == lines.npos ? lines.size() : pos + 1);
 
     if (line.empty())
       continue;
-    if (line.front() == L'#')  // comment
+    if (line.front() == '#')  // comment
       continue;
 
-    if (StartsWith(line, L"::")) {
-      auto section = line.substr(2);
-      if (section == L"meta") {
+    if (Consume(line, "::")) {
+      if (line == "meta") {
         current_section = FileSection::Meta;
-      } else if (section == L"rules") {
+      } else if (line == "rules") {
         current_section = FileSection::Rules;
       } else {
         current_section = FileSection::Unknown;
@@ -186,32 +343,55 @@ bool Engine::ReadRelations(const std::string& document) {
 
     switch (current_section) {
       case FileSection::Meta: {
-        TrimLeft(line, L"- ");
-        static const std::wregex pattern(L"([a-z_]+): (.+)");
-        std::match_results<std::wstring::const_iterator> match_results;
-        if (std::regex_match(line, match_results, pattern)) {
-          auto name = match_results[1].str();
-          auto value = match_results[2].str();
-          if (name == L"version") {
-            semaver::Version version(WstrToStr(value));
-            if (version > Taiga.version)
+        std::string_view name;
+        std::string_view value;
+        if (ParseMeta(TrimLeft(line, "- "), name, value)) {
+          if (name == "version") {
+            semaver::Version version{std::string(value)};
+            if (version > GetApplicationVersion())
               LOGD(L"Anime relations version is larger than application version.");
-          } else if (name == L"last_modified") {
-            Settings.Set(taiga::kRecognition_RelationsLastModified, value);
+          } else if (name == "last_modified" && !detached_) {
+            Settings.Set(taiga::kRecognition_RelationsLastModified,
+                         StrToWstr(std::string(value)));
           }
         }
         break;
       }
       case FileSection::Rules: {
-        TrimLeft(line, L"- ");
-        if (!ParseRule(line))
-          LOGW(L"Could not parse rule: {}", line);
+        line = TrimLeft(line, "- ");
+        if (!ParseRule(line, new_relations))
+          LOGW(L"Could not parse rule: {}", StrToWstr(std::string(line)));
         break;
       }
     }
   }
 
-  return !relations.empty();
+  const bool succeeded = !new_relations.rules().empty();
+
+  {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    relations_.swap(new_relations);
+  }
+
+  InvalidateCache();
+
+  return succeeded;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void Engine::ExportRelations(std::vector<RelationRule>& rules) const {
+  rules = relations_.rules();
+}
+
+void Engine::ImportRelations(const std::vector<RelationRule>& rules) {
+  RelationTable new_relations;
+
+  for (const auto& rule : rules) {
+    new_relations.AddRule(rule);
+  }
+
+  relations_.swap(new_relations);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -219,13 +399,16 @@ bool Engine::ReadRelations(const std::string& document) {
 bool Engine::SearchEpisodeRedirection(
     int id, const std::pair<int, int>& range,
     int& destination_id, std::pair<int, int>& destination_range) const {
+  StageTimer timer(*this, kStageRedirection);
 
-  auto it = relations.find(id);
+  const auto relation_ptr =
+      relations_.Find(GetServiceColumn(taiga::GetCurrentServiceId()), id);
 
-  if (it == relations.end())
+  if (!relation_ptr)
     return false;
 
-  const auto& relation = it->second;
+  const auto& relation = *relation_ptr;
+  timer.AddCandidates(relation.ranges().size());
 
   std::pair<std::pair<int, int>, std::pair<int, int>> results;
 
@@ -242,6 +425,7 @@ bool Engine::SearchEpisodeRedirection(
   destination_id = results.first.first;
   destination_range.first = results.first.second;
   destination_range.second = results.second.second;
+  timer.Hit();
 
   return true;
 }
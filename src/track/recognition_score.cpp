@@ -17,6 +17,7 @@
 */
 
 #include <algorithm>
+#include <cmath>
 
 #include "base/string.h"
 #include "library/anime_db.h"
@@ -27,12 +28,10 @@
 namespace track {
 namespace recognition {
 
-sorted_scores_t Engine::GetScores() const {
-  return scores_;
-}
-
 int Engine::ScoreTitle(anime::Episode& episode, const std::set<int>& anime_ids,
-                       const MatchOptions& match_options) {
+                       const MatchOptions& match_options, bool give_score,
+                       sorted_scores_t& scores) const {
+  StageTimer timer(*this, kStageScoring);
   scores_t trigram_results;
 
   auto normal_title = episode.anime_title();
@@ -42,7 +41,10 @@ int Engine::ScoreTitle(anime::Episode& episode, const std::set<int>& anime_ids,
   GetTrigrams(normal_title, t1);
 
   auto calculate_trigram_results = [&](int anime_id) {
-    for (const auto& t2 : db_[anime_id].trigrams) {
+    const auto store = FindScoreStore(anime_id);
+    if (!store)
+      return;
+    for (const auto& t2 : store->trigrams) {
       double result = CompareTrigrams(t1, t2);
       if (result > 0.1) {
         auto& target = trigram_results[anime_id];
@@ -56,13 +58,67 @@ int Engine::ScoreTitle(anime::Episode& episode, const std::set<int>& anime_ids,
       calculate_trigram_results(id);
     }
   } else {
-    for (const auto& it : AnimeDatabase.items) {
-      if (ValidateOptions(episode, it.second, match_options, false))
-        calculate_trigram_results(it.first);
+    // Only the titles that share trigrams with the query can have a score
+    // above the threshold, so we don't need to walk the entire database.
+    scores_t candidates;
+    GetTrigramResults(t1, candidates);
+    for (const auto& candidate : candidates) {
+      auto anime_item = database_.FindItem(candidate.first, false);
+      if (anime_item &&
+          ValidateOptions(episode, *anime_item, match_options, false))
+        trigram_results.insert(candidate);
     }
   }
 
-  return ScoreTitle(normal_title, episode, trigram_results);
+  const int anime_id =
+      ScoreTitle(normal_title, episode, trigram_results, give_score, scores);
+  timer.AddCandidates(trigram_results.size());
+  if (anime::IsValidId(anime_id))
+    timer.Hit();
+
+  return anime_id;
+}
+
+void Engine::GetTrigramResults(const trigram_container_t& trigrams,
+                               scores_t& trigram_results) const {
+  // Number of shared trigrams for each title of each anime
+  std::map<int, std::vector<size_t>> counts;
+
+  for (auto it = trigrams.begin(); it != trigrams.end(); ) {
+    auto it_end = std::find_if(it, trigrams.end(),
+        [&it](const trigram_t& trigram) { return trigram != *it; });
+    const size_t query_count = std::distance(it, it_end);
+
+    auto postings = trigram_index_.find(*it);
+    if (postings != trigram_index_.end()) {
+      for (const auto& posting : postings->second) {
+        auto& count = counts[posting.anime_id];
+        if (count.size() <= posting.title_index)
+          count.resize(posting.title_index + 1);
+        count[posting.title_index] +=
+            std::min<size_t>(query_count, posting.count);
+      }
+    }
+
+    it = it_end;
+  }
+
+  // The sum of the minimum counts is the size of the intersection, so the
+  // result is the same as what CompareTrigrams would return.
+  for (const auto& it : counts) {
+    const auto& store = *FindScoreStore(it.first);
+    for (size_t i = 0; i < it.second.size(); ++i) {
+      if (!it.second[i])
+        continue;
+      const double result = static_cast<double>(it.second[i]) /
+          static_cast<double>(std::max(trigrams.size(),
+                                       store.trigrams.at(i).size()));
+      if (result > 0.1) {
+        auto& target = trigram_results[it.first];
+        target = std::max(target, result);
+      }
+    }
+  }
 }
 
 static double CustomScore(const std::wstring& title, const std::wstring& str) {
@@ -93,9 +149,10 @@ static double CustomScore(const std::wstring& title, const std::wstring& str) {
   return score;
 };
 
-static double BonusScore(const anime::Episode& episode, int id) {
+static double BonusScore(anime::Database& database,
+                         const anime::Episode& episode, int id) {
   double score = 0.0;
-  auto anime_item = AnimeDatabase.FindItem(id);
+  auto anime_item = database.FindItem(id);
 
   if (anime_item) {
     auto anime_year = episode.anime_year();
@@ -112,47 +169,132 @@ static double BonusScore(const anime::Episode& episode, int id) {
   return score;
 };
 
+// Upper bounds of the individual scores, given the ratio of the lengths of
+// the strings. Matching characters, common prefixes and common subsequences
+// can't be longer than the shorter string, and the edit distance is at least
+// the difference in length. These are much cheaper than the scores themselves.
+static double JaroWinklerBound(double length_ratio) {
+  const double jaro = (2.0 + length_ratio) / 3.0;
+  return jaro + (4 * 0.1 * (1.0 - jaro));
+}
+
+static double LevenshteinBound(double length_ratio) {
+  return length_ratio;
+}
+
+static double CustomBound(double length_ratio) {
+  return std::max(length_ratio, 0.7);
+}
+
+// Bounds are compared with some tolerance for rounding errors, so that pruning
+// never changes the results.
+static bool CanExceed(double bound, double score) {
+  return bound + 1e-9 > score;
+}
+
+static double LengthRatio(const std::wstring& title, const std::wstring& str) {
+  const size_t length_max = std::max(title.size(), str.size());
+  if (!length_max)
+    return 1.0;
+  return static_cast<double>(std::min(title.size(), str.size())) / length_max;
+}
+
+static double AverageScore(double jaro_winkler, double levenshtein,
+                           double custom, double trigram, double bonus) {
+  return (((1.0 * jaro_winkler) +
+           (0.5 * std::pow(custom, 0.66)) +
+           (0.3 * std::pow(levenshtein, 0.8)) +
+           (0.2 * std::pow(trigram, 0.8))) / 2.0) + bonus;
+}
+
 int Engine::ScoreTitle(const std::wstring& str, const anime::Episode& episode,
-                       const scores_t& trigram_results) {
-  scores_t jaro_winkler, levenshtein, custom, bonus;
+                       const scores_t& trigram_results, bool give_score,
+                       sorted_scores_t& scores) const {
+  // Scores are only kept if they're good enough to be shown, or to be accepted
+  // as a match when they're not going to be shown.
+  const double min_score = give_score ? 0.3 : 1.0;
+  const size_t max_count = give_score ? 20 : 2;
 
-  scores_.clear();
+  struct Candidate {
+    int id;
+    double trigram;
+    double bonus;
+    double bound;
+  };
+  std::vector<Candidate> candidates;
+  candidates.reserve(trigram_results.size());
 
   for (const auto& trigram_result : trigram_results) {
-    int id = trigram_result.first;
+    const int id = trigram_result.first;
+    double length_ratio = 0.0;
+    for (const auto& title : FindScoreStore(id)->normal_titles) {
+      length_ratio = std::max(length_ratio, LengthRatio(title, str));
+    }
+    const double bonus = BonusScore(database_, episode, id);
+    const double bound = AverageScore(
+        JaroWinklerBound(length_ratio), LevenshteinBound(length_ratio),
+        CustomBound(length_ratio), trigram_result.second, bonus);
+    if (CanExceed(bound, min_score))
+      candidates.push_back({id, trigram_result.second, bonus, bound});
+  }
+
+  // Candidates with higher bounds are more likely to end up with higher
+  // scores, which lets us stop early once the results are full.
+  std::stable_sort(candidates.begin(), candidates.end(),
+      [](const Candidate& a, const Candidate& b) {
+        return a.bound > b.bound;
+      });
+
+  // Sorted in descending order, where equal scores are sorted by ID
+  auto comp = [](const std::pair<int, double>& a,
+                 const std::pair<int, double>& b) {
+    if (a.second != b.second)
+      return a.second > b.second;
+    return a.first < b.first;
+  };
 
-    // Calculate individual scores for all titles
-    for (auto& title : db_[id].normal_titles) {
-      jaro_winkler[id] = std::max(jaro_winkler[id], JaroWinklerDistance(title, str));
-      levenshtein[id] = std::max(levenshtein[id], LevenshteinDistance(title, str));
-      custom[id] = std::max(custom[id], CustomScore(title, str));
+  scores.clear();
+
+  for (const auto& candidate : candidates) {
+    const double threshold = scores.size() < max_count ?
+        min_score : std::max(min_score, scores.back().second);
+    if (!CanExceed(candidate.bound, threshold))
+      break;
+
+    // Calculate individual scores for all titles, unless a title can't
+    // improve on the ones before it
+    double jaro_winkler = 0.0;
+    double levenshtein = 0.0;
+    double custom = 0.0;
+    for (const auto& title : FindScoreStore(candidate.id)->normal_titles) {
+      const double length_ratio = LengthRatio(title, str);
+      if (CanExceed(JaroWinklerBound(length_ratio), jaro_winkler))
+        jaro_winkler = std::max(jaro_winkler, JaroWinklerDistance(title, str));
+      if (CanExceed(LevenshteinBound(length_ratio), levenshtein))
+        levenshtein = std::max(levenshtein, LevenshteinDistance(title, str));
+      if (CanExceed(CustomBound(length_ratio), custom))
+        custom = std::max(custom, CustomScore(title, str));
     }
-    bonus[id] = BonusScore(episode, id);
 
     // Calculate the average score for the ID
-    double score =
-        (((1.0 * jaro_winkler[id]) +
-          (0.5 * std::pow(custom[id], 0.66)) +
-          (0.3 * std::pow(levenshtein[id], 0.8)) +
-          (0.2 * std::pow(trigram_result.second, 0.8))) / 2.0) + bonus[id];
-    if (score >= 0.3)
-      scores_.push_back(std::make_pair(id, score));
+    const std::pair<int, double> score{candidate.id, AverageScore(
+        jaro_winkler, levenshtein, custom, candidate.trigram, candidate.bonus)};
+    if (!(score.second >= min_score))
+      continue;
+    if (scores.size() == max_count) {
+      if (!comp(score, scores.back()))
+        continue;
+      scores.pop_back();
+    }
+    scores.insert(std::upper_bound(scores.begin(), scores.end(), score, comp),
+                  score);
   }
 
-  // Sort scores in descending order, then limit the results
-  std::stable_sort(scores_.begin(), scores_.end(),
-      [&](const std::pair<int, double>& a,
-          const std::pair<int, double>& b) {
-        return a.second > b.second;
-      });
-  if (scores_.size() > 20)
-    scores_.resize(20);
-
-  double score_1st = scores_.size() > 0 ? scores_.at(0).second : 0.0;
-  double score_2nd = scores_.size() > 1 ? scores_.at(1).second : 0.0;
+  double score_1st = scores.size() > 0 ? scores.at(0).second : 0.0;
+  double score_2nd = scores.size() > 1 ? scores.at(1).second : 0.0;
 
   if (score_1st >= 1.0 && score_1st != score_2nd)
-    return scores_.front().first;
+    return scores.front().first;
 
   return anime::ID_UNKNOWN;
 }
@@ -0,0 +1,432 @@
+/*
+** Taiga
+** Copyright (C) 2010-2018, Eren Okka
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+#include "base/file.h"
+#include "base/log.h"
+#include "library/anime_db.h"
+#include "library/anime_util.h"
+#include "taiga/path.h"
+#include "track/recognition.h"
+
+namespace track {
+namespace recognition {
+
+// Snapshots are only read by the same build that wrote them, so values are
+// stored as they are in memory. The version must be increased whenever the
+// layout of the data or the way titles are normalized changes.
+constexpr UINT32 kSnapshotMagic = 0x4e534754;  // "TGSN"
+constexpr UINT32 kSnapshotVersion = 2;
+
+constexpr size_t kTitleTableCount = 6;
+
+class SnapshotReader {
+public:
+  SnapshotReader(const char* data, size_t size)
+      : pos_(data), end_(data + size) {}
+
+  template <typename T>
+  bool Read(T& value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    if (static_cast<size_t>(end_ - pos_) < sizeof(T))
+      return false;
+    std::memcpy(&value, pos_, sizeof(T));
+    pos_ += sizeof(T);
+    return true;
+  }
+
+  template <typename T>
+  bool Read(std::vector<T>& values) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    UINT32 count = 0;
+    if (!Read(count) || static_cast<size_t>(end_ - pos_) / sizeof(T) < count)
+      return false;
+    values.resize(count);
+    if (count)
+      std::memcpy(values.data(), pos_, count * sizeof(T));
+    pos_ += count * sizeof(T);
+    return true;
+  }
+
+  bool Read(std::wstring& str) {
+    UINT32 length = 0;
+    if (!Read(length) ||
+        static_cast<size_t>(end_ - pos_) / sizeof(wchar_t) < length)
+      return false;
+    str.assign(reinterpret_cast<const wchar_t*>(pos_), length);
+    pos_ += length * sizeof(wchar_t);
+    return true;
+  }
+
+  bool at_end() const {
+    return pos_ == end_;
+  }
+
+private:
+  const char* pos_;
+  const char* end_;
+};
+
+class SnapshotWriter {
+public:
+  SnapshotWriter(std::string& output) : output_(output) {}
+
+  template <typename T>
+  void Write(const T& value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    output_.append(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  template <typename T>
+  void Write(const std::vector<T>& values) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    Write(static_cast<UINT32>(values.size()));
+    output_.append(reinterpret_cast<const char*>(values.data()),
+                   values.size() * sizeof(T));
+  }
+
+  void Write(const std::wstring& str) {
+    Write(static_cast<UINT32>(str.size()));
+    output_.append(reinterpret_cast<const char*>(str.data()),
+                   str.size() * sizeof(wchar_t));
+  }
+
+private:
+  std::string& output_;
+};
+
+// 64-bit FNV-1a
+class Checksum {
+public:
+  void Update(const void* data, size_t size) {
+    const auto bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+      value_ ^= bytes[i];
+      value_ *= 1099511628211ull;
+    }
+  }
+
+  template <typename T>
+  void Update(const T& value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    Update(&value, sizeof(T));
+  }
+
+  void Update(const std::wstring& str) {
+    Update(str.size());
+    Update(str.data(), str.size() * sizeof(wchar_t));
+  }
+
+  UINT64 value() const {
+    return value_;
+  }
+
+private:
+  UINT64 value_ = 14695981039346656037ull;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool TitleTable::Load(SnapshotReader& reader) {
+  UINT32 list_count = 0;
+  UINT64 size = 0;
+  UINT64 garbage = 0;
+
+  if (!reader.Read(buffer_) || !reader.Read(garbage) ||
+      !reader.Read(entries_) || !reader.Read(free_entries_) ||
+      !reader.Read(list_count))
+    return false;
+
+  lists_.resize(list_count);
+  for (auto& list : lists_) {
+    if (!reader.Read(list))
+      return false;
+  }
+
+  if (!reader.Read(free_lists_) || !reader.Read(slots_) || !reader.Read(size))
+    return false;
+
+  // Make sure that lookups and updates can't go out of bounds
+  std::vector<bool> used_lists(lists_.size());
+  size_t entry_count = 0;
+  for (const auto& entry : entries_) {
+    if (entry.offset == npos)
+      continue;
+    ++entry_count;
+    if (entry.offset > buffer_.size() ||
+        entry.length > buffer_.size() - entry.offset ||
+        entry.list > lists_.size())
+      return false;
+    if (entry.list) {
+      if (used_lists[entry.list - 1])
+        return false;
+      used_lists[entry.list - 1] = true;
+    }
+  }
+
+  // Free entries and lists are reused as they are, so they must not be in use
+  std::vector<bool> free_entries(entries_.size());
+  for (const auto& index : free_entries_) {
+    if (index >= entries_.size() || entries_[index].offset != npos ||
+        free_entries[index])
+      return false;
+    free_entries[index] = true;
+  }
+  for (const auto& index : free_lists_) {
+    if (index >= lists_.size() || used_lists[index])
+      return false;
+    used_lists[index] = true;
+  }
+
+  // Each entry must be in exactly one slot, and as probing stops at an empty
+  // slot, there must be at least one of those
+  if (slots_.size() & (slots_.size() - 1))
+    return false;
+  std::vector<bool> used_entries(entries_.size());
+  size_t used_slots = 0;
+  for (const auto& slot : slots_) {
+    if (!slot)
+      continue;
+    if (slot > entries_.size() || entries_[slot - 1].offset == npos ||
+        used_entries[slot - 1])
+      return false;
+    used_entries[slot - 1] = true;
+    ++used_slots;
+  }
+  if (used_slots != entry_count || used_slots != size ||
+      (used_slots && used_slots >= slots_.size()))
+    return false;
+
+  garbage_ = static_cast<size_t>(garbage);
+  size_ = static_cast<size_t>(size);
+
+  return true;
+}
+
+void TitleTable::Save(SnapshotWriter& writer) const {
+  writer.Write(buffer_);
+  writer.Write(static_cast<UINT64>(garbage_));
+  writer.Write(entries_);
+  writer.Write(free_entries_);
+  writer.Write(static_cast<UINT32>(lists_.size()));
+  for (const auto& list : lists_) {
+    writer.Write(list);
+  }
+  writer.Write(free_lists_);
+  writer.Write(slots_);
+  writer.Write(static_cast<UINT64>(size_));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+UINT64 Engine::GetSnapshotChecksum() const {
+  Checksum checksum;
+
+  checksum.Update(kSnapshotVersion);
+  checksum.Update(sizeof(size_t));
+
+  // Titles
+  for (const auto& it : database_.items) {
+    const auto& anime_item = it.second;
+    checksum.Update(anime_item.GetId());
+    checksum.Update(anime_item.GetTitle());
+    checksum.Update(anime_item.GetEnglishTitle());
+    checksum.Update(anime_item.GetJapaneseTitle());
+    const auto& date = anime_item.GetDateStart();
+    checksum.Update(anime::IsValidDate(date) ? static_cast<int>(date.year()) : 0);
+    checksum.Update(anime_item.GetSynonyms().size());
+    for (const auto& synonym : anime_item.GetSynonyms()) {
+      checksum.Update(synonym);
+    }
+    checksum.Update(anime_item.GetUserSynonyms().size());
+    for (const auto& synonym : anime_item.GetUserSynonyms()) {
+      checksum.Update(synonym);
+    }
+  }
+
+  // Relations
+  std::string document;
+  ReadFromFile(taiga::GetPath(taiga::Path::DatabaseAnimeRelations), document);
+  checksum.Update(document.size());
+  checksum.Update(document.data(), document.size());
+
+  return checksum.value();
+}
+
+bool Engine::LoadSnapshot(UINT64 checksum) {
+  MappedFile file;
+  if (!file.Open(taiga::GetPath(taiga::Path::DatabaseRecognition)))
+    return false;
+
+  SnapshotReader reader(file.data(), file.size());
+
+  UINT32 magic = 0;
+  UINT32 version = 0;
+  UINT64 snapshot_checksum = 0;
+  if (!reader.Read(magic) || magic != kSnapshotMagic ||
+      !reader.Read(version) || version != kSnapshotVersion ||
+      !reader.Read(snapshot_checksum) || snapshot_checksum != checksum) {
+    LOGD(L"Recognition snapshot is out of date.");
+    return false;
+  }
+
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+
+  auto read_data = [&]() {
+    for (size_t i = 0; i < kTitleTableCount; ++i) {
+      if (!GetTitleTable(i)->Load(reader))
+        return false;
+    }
+
+    if (!reader.Read(db_index_))
+      return false;
+
+    UINT32 store_count = 0;
+    if (!reader.Read(store_count))
+      return false;
+    db_.resize(store_count);
+    for (auto& store : db_) {
+      UINT32 title_count = 0;
+      if (!reader.Read(title_count))
+        return false;
+      store.normal_titles.resize(title_count);
+      store.trigrams.resize(title_count);
+      for (UINT32 i = 0; i < title_count; ++i) {
+        if (!reader.Read(store.normal_titles[i]) ||
+            !reader.Read(store.trigrams[i]))
+          return false;
+      }
+      UINT32 key_count = 0;
+      if (!reader.Read(key_count))
+        return false;
+      store.title_keys.resize(key_count);
+      for (auto& key : store.title_keys) {
+        UINT32 table = 0;
+        if (!reader.Read(table) || !reader.Read(key.index))
+          return false;
+        key.titles = GetTitleTable(table);
+        if (!key.titles || !key.titles->HasEntry(key.index))
+          return false;
+      }
+    }
+    for (const auto& index : db_index_) {
+      if (index > db_.size())
+        return false;
+    }
+
+    std::vector<RelationRule> relation_rules;
+    if (!reader.Read(relation_rules) || !reader.at_end())
+      return false;
+    ImportRelations(relation_rules);
+
+    return true;
+  };
+
+  if (!read_data()) {
+    LOGW(L"Could not read recognition snapshot.");
+    for (size_t i = 0; i < kTitleTableCount; ++i) {
+      *GetTitleTable(i) = TitleTable();
+    }
+    db_.clear();
+    db_index_.clear();
+    ImportRelations({});
+    return false;
+  }
+
+  // Postings are cheap to build from the stored trigrams
+  trigram_index_.clear();
+  for (size_t anime_id = 0; anime_id < db_index_.size(); ++anime_id) {
+    if (db_index_[anime_id])
+      AddTrigramPostings(static_cast<int>(anime_id));
+  }
+
+  lock.unlock();
+  InvalidateCache();
+
+  return true;
+}
+
+void Engine::SaveSnapshot(UINT64 checksum) const {
+  std::string output;
+  SnapshotWriter writer(output);
+
+  writer.Write(kSnapshotMagic);
+  writer.Write(kSnapshotVersion);
+  writer.Write(checksum);
+
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+
+    for (size_t i = 0; i < kTitleTableCount; ++i) {
+      GetTitleTable(i)->Save(writer);
+    }
+
+    writer.Write(db_index_);
+
+    writer.Write(static_cast<UINT32>(db_.size()));
+    for (const auto& store : db_) {
+      writer.Write(static_cast<UINT32>(store.normal_titles.size()));
+      for (size_t i = 0; i < store.normal_titles.size(); ++i) {
+        writer.Write(store.normal_titles[i]);
+        writer.Write(store.trigrams[i]);
+      }
+      writer.Write(static_cast<UINT32>(store.title_keys.size()));
+      for (const auto& key : store.title_keys) {
+        writer.Write(static_cast<UINT32>(GetTitleTableIndex(key.titles)));
+        writer.Write(key.index);
+      }
+    }
+
+    std::vector<RelationRule> relation_rules;
+    ExportRelations(relation_rules);
+    writer.Write(relation_rules);
+  }
+
+  if (!SaveToFile(output, taiga::GetPath(taiga::Path::DatabaseRecognition)))
+    LOGW(L"Could not save recognition snapshot.");
+}
+
+const TitleTable* Engine::GetTitleTable(size_t index) const {
+  switch (index) {
+    case 0: return &titles_.main;
+    case 1: return &titles_.alternative;
+    case 2: return &titles_.user;
+    case 3: return &normal_titles_.main;
+    case 4: return &normal_titles_.alternative;
+    case 5: return &normal_titles_.user;
+    default: return nullptr;
+  }
+}
+
+TitleTable* Engine::GetTitleTable(size_t index) {
+  return const_cast<TitleTable*>(std::as_const(*this).GetTitleTable(index));
+}
+
+size_t Engine::GetTitleTableIndex(const TitleTable* table) const {
+  for (size_t i = 0; i < kTitleTableCount; ++i) {
+    if (GetTitleTable(i) == table)
+      return i;
+  }
+  return kTitleTableCount;
+}
+
+}  // namespace recognition
+}  // namespace track
@@ -0,0 +1,116 @@
+/*
+** Taiga
+** Copyright (C) 2010-2018, Eren Okka
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "base/log.h"
+#include "base/string.h"
+#include "track/recognition.h"
+
+namespace track {
+namespace recognition {
+
+// Counters are only ever added to, so they don't need to be ordered with
+// anything else.
+constexpr auto kRelaxed = std::memory_order_relaxed;
+
+Engine::StageTimer::StageTimer(const Engine& engine, Stage stage)
+    : engine_(engine),
+      stage_(stage),
+      enabled_(engine.stage_stats_enabled_.load(kRelaxed)) {
+  if (enabled_)
+    t0_ = std::chrono::steady_clock::now();
+}
+
+Engine::StageTimer::~StageTimer() {
+  if (!enabled_)
+    return;
+
+  const auto duration = std::chrono::steady_clock::now() - t0_;
+  auto& counters = engine_.stage_counters_[stage_];
+  counters.calls.fetch_add(1, kRelaxed);
+  counters.nanoseconds.fetch_add(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(),
+      kRelaxed);
+}
+
+void Engine::StageTimer::AddCandidates(size_t count) {
+  if (enabled_)
+    engine_.stage_counters_[stage_].candidates.fetch_add(count, kRelaxed);
+}
+
+void Engine::StageTimer::Hit() {
+  if (enabled_)
+    engine_.stage_counters_[stage_].hits.fetch_add(1, kRelaxed);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+const char* Engine::GetStageName(Stage stage) {
+  switch (stage) {
+    case kStageMergedTitleLookup: return "merged_title_lookup";
+    case kStageTitleLookup: return "title_lookup";
+    case kStageDirectoryLookup: return "directory_lookup";
+    case kStageValidation: return "validation";
+    case kStageRedirection: return "redirection";
+    case kStageScoring: return "scoring";
+    default: return "";
+  }
+}
+
+void Engine::EnableStageStats(bool enable) {
+  stage_stats_enabled_ = enable;
+}
+
+Engine::stage_stats_t Engine::GetStageStats() const {
+  stage_stats_t stats;
+
+  for (size_t i = 0; i < kStageCount; ++i) {
+    const auto& counters = stage_counters_[i];
+    stats[i].calls = counters.calls.load(kRelaxed);
+    stats[i].hits = counters.hits.load(kRelaxed);
+    stats[i].candidates = counters.candidates.load(kRelaxed);
+    stats[i].time =
+        std::chrono::nanoseconds(counters.nanoseconds.load(kRelaxed));
+  }
+
+  return stats;
+}
+
+void Engine::ResetStageStats() {
+  for (auto& counters : stage_counters_) {
+    counters.calls = 0;
+    counters.hits = 0;
+    counters.candidates = 0;
+    counters.nanoseconds = 0;
+  }
+}
+
+void Engine::LogStageStats() const {
+  const auto stats = GetStageStats();
+
+  for (size_t i = 0; i < kStageCount; ++i) {
+    const auto& stage = stats[i];
+    const auto milliseconds =
+        std::chrono::duration<double, std::milli>(stage.time).count();
+    LOGI(L"{}: {} calls, {} hits, {} candidates, {:.3f}ms",
+         StrToWstr(GetStageName(static_cast<Stage>(i))),
+         stage.calls, stage.hits, stage.candidates, milliseconds);
+  }
+}
+
+}  // namespace recognition
+}  // namespace track
@@ -0,0 +1,221 @@
+/*
+** Taiga
+** Copyright (C) 2010-2018, Eren Okka
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+
+#include "track/recognition.h"
+
+namespace track {
+namespace recognition {
+
+constexpr size_t kMinSlotCount = 16;
+
+// FNV-1a, which unlike std::hash is guaranteed to stay the same between builds,
+// as hashes are stored in snapshots.
+static size_t HashTitle(std::wstring_view title) {
+  size_t hash = 2166136261u;
+  for (const auto c : title) {
+    hash ^= static_cast<size_t>(c);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+bool TitleTable::Find(const std::wstring& title,
+                      std::set<int>& anime_ids) const {
+  if (slots_.empty())
+    return false;
+
+  const auto index = slots_[FindSlot(title, HashTitle(title))];
+  if (!index)
+    return false;
+
+  const auto& entry = entries_[index - 1];
+  if (entry.list) {
+    const auto& list = lists_[entry.list - 1];
+    anime_ids.insert(list.begin(), list.end());
+  } else {
+    anime_ids.insert(entry.anime_id);
+  }
+
+  return true;
+}
+
+unsigned int TitleTable::Insert(const std::wstring& title, int anime_id) {
+  // Keep the load factor below 3/4, so that probe sequences stay short
+  if ((size_ + 1) * 4 > slots_.size() * 3)
+    Rehash(std::max(kMinSlotCount, slots_.size() * 2));
+
+  const auto hash = HashTitle(title);
+  const auto slot = FindSlot(title, hash);
+
+  if (slots_[slot]) {
+    const unsigned int index = slots_[slot] - 1;
+    auto& entry = entries_[index];
+    if (entry.list) {
+      auto& list = lists_[entry.list - 1];
+      if (std::find(list.begin(), list.end(), anime_id) != list.end())
+        return npos;
+      list.push_back(anime_id);
+    } else {
+      if (entry.anime_id == anime_id)
+        return npos;
+      unsigned int list_index;
+      if (!free_lists_.empty()) {
+        list_index = free_lists_.back();
+        free_lists_.pop_back();
+      } else {
+        list_index = static_cast<unsigned int>(lists_.size());
+        lists_.emplace_back();
+      }
+      lists_[list_index] = {entry.anime_id, anime_id};
+      entry.list = list_index + 1;
+    }
+    return index;
+  }
+
+  unsigned int index;
+  if (!free_entries_.empty()) {
+    index = free_entries_.back();
+    free_entries_.pop_back();
+  } else {
+    index = static_cast<unsigned int>(entries_.size());
+    entries_.emplace_back();
+  }
+
+  auto& entry = entries_[index];
+  entry.hash = hash;
+  entry.offset = static_cast<unsigned int>(buffer_.size());
+  entry.length = static_cast<unsigned int>(title.size());
+  entry.anime_id = anime_id;
+  entry.list = 0;
+  buffer_.append(title);
+
+  slots_[slot] = index + 1;
+  ++size_;
+
+  return index;
+}
+
+void TitleTable::Erase(unsigned int index, int anime_id) {
+  if (index >= entries_.size())
+    return;
+
+  auto& entry = entries_[index];
+
+  if (entry.list) {
+    auto& list = lists_[entry.list - 1];
+    list.erase(std::remove(list.begin(), list.end(), anime_id), list.end());
+    // Lists start with two IDs, so there is at least one left
+    if (list.size() == 1) {
+      entry.anime_id = list.front();
+      std::vector<int>().swap(list);
+      free_lists_.push_back(entry.list - 1);
+      entry.list = 0;
+    }
+    return;
+  }
+
+  if (entry.anime_id != anime_id)
+    return;
+
+  EraseSlot(FindSlot(GetTitle(entry), entry.hash));
+
+  garbage_ += entry.length;
+  entry = Entry{};
+  free_entries_.push_back(index);
+  --size_;
+
+  if (garbage_ > buffer_.size() / 2)
+    CompactBuffer();
+}
+
+bool TitleTable::HasEntry(unsigned int index) const {
+  return index < entries_.size() && entries_[index].offset != npos;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+std::wstring_view TitleTable::GetTitle(const Entry& entry) const {
+  return std::wstring_view(buffer_.data() + entry.offset, entry.length);
+}
+
+size_t TitleTable::FindSlot(std::wstring_view title, size_t hash) const {
+  const size_t mask = slots_.size() - 1;
+
+  for (size_t slot = hash & mask; ; slot = (slot + 1) & mask) {
+    const auto index = slots_[slot];
+    if (!index)
+      return slot;
+    const auto& entry = entries_[index - 1];
+    if (entry.hash == hash && GetTitle(entry) == title)
+      return slot;
+  }
+}
+
+void TitleTable::EraseSlot(size_t slot) {
+  const size_t mask = slots_.size() - 1;
+
+  // Shift the following entries back, unless that would move them before
+  // their home slot, so that lookups never stop at the hole too early.
+  for (size_t next = (slot + 1) & mask; slots_[next];
+       next = (next + 1) & mask) {
+    const size_t home = entries_[slots_[next] - 1].hash & mask;
+    if (((next - home) & mask) >= ((next - slot) & mask)) {
+      slots_[slot] = slots_[next];
+      slot = next;
+    }
+  }
+
+  slots_[slot] = 0;
+}
+
+void TitleTable::Rehash(size_t slot_count) {
+  const size_t mask = slot_count - 1;
+
+  slots_.assign(slot_count, 0);
+
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    const auto& entry = entries_[i];
+    if (entry.offset == npos)
+      continue;
+    size_t slot = entry.hash & mask;
+    while (slots_[slot])
+      slot = (slot + 1) & mask;
+    slots_[slot] = static_cast<unsigned int>(i + 1);
+  }
+}
+
+void TitleTable::CompactBuffer() {
+  std::wstring buffer;
+  buffer.reserve(buffer_.size() - garbage_);
+
+  for (auto& entry : entries_) {
+    if (entry.offset == npos)
+      continue;
+    const auto offset = static_cast<unsigned int>(buffer.size());
+    buffer.append(GetTitle(entry));
+    entry.offset = offset;
+  }
+
+  buffer_.swap(buffer);
+  garbage_ = 0;
+}
+
+}  // namespace recognition
+}  // namespace track
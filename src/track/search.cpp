@@ -30,6 +30,8 @@
 
 TaigaFileSearchHelper file_search_helper;
 
+constexpr size_t kFileBatchSize = 256;
+
 TaigaFileSearchHelper::TaigaFileSearchHelper()
     : anime_id_(anime::ID_UNKNOWN),
       episode_number_(0) {
@@ -38,6 +40,10 @@ TaigaFileSearchHelper::TaigaFileSearchHelper()
 bool TaigaFileSearchHelper::OnDirectory(const std::wstring& root,
                                         const std::wstring& name,
                                         const WIN32_FIND_DATA& data) {
+  // Files that come before the directory must be processed first
+  if (ProcessFiles())
+    return true;
+
   static track::recognition::ParseOptions parse_options;
   parse_options.parse_path = false;
   parse_options.streaming_media = false;
@@ -75,16 +81,50 @@ bool TaigaFileSearchHelper::OnDirectory(const std::wstring& root,
 bool TaigaFileSearchHelper::OnFile(const std::wstring& root,
                                    const std::wstring& name,
                                    const WIN32_FIND_DATA& data) {
-  auto path = AddTrailingSlash(root) + name;
+  files_.push_back(AddTrailingSlash(root) + name);
+
+  if (files_.size() < kFileBatchSize)
+    return false;
+
+  return ProcessFiles();
+}
+
+bool TaigaFileSearchHelper::Search(const std::wstring& root) {
+  if (FileSearchHelper::Search(root))
+    return true;
+
+  return ProcessFiles();
+}
+
+bool TaigaFileSearchHelper::ProcessFiles() {
+  if (files_.empty())
+    return false;
+
+  std::vector<std::wstring> paths;
+  paths.swap(files_);
 
   static track::recognition::ParseOptions parse_options;
   parse_options.parse_path = true;
   parse_options.streaming_media = false;
 
-  if (!Meow.Parse(path, parse_options, episode_)) {
-    LOGD(L"Could not parse filename: {}", name);
-    return false;
+  std::vector<anime::Episode> episodes;
+  std::vector<char> parse_results;
+  Meow.ParseBatch(paths, parse_options, episodes, parse_results);
+
+  size_t count = 0;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    if (!parse_results[i]) {
+      LOGD(L"Could not parse filename: {}", GetFileName(paths[i]));
+      continue;
+    }
+    if (count != i) {
+      paths[count] = std::move(paths[i]);
+      episodes[count] = std::move(episodes[i]);
+    }
+    ++count;
   }
+  paths.resize(count);
+  episodes.resize(count);
 
   static track::recognition::MatchOptions match_options;
   match_options.allow_sequels = true;
@@ -93,18 +133,27 @@ bool TaigaFileSearchHelper::OnFile(const std::wstring& root,
   match_options.check_episode_number = true;
   match_options.streaming_media = false;
 
-  Meow.Identify(episode_, false, match_options);
+  bool found = false;
+  Meow.IdentifyBatch(episodes, match_options, [&](size_t i) {
+    found = OnFileIdentified(paths[i], episodes[i]);
+    return found;
+  });
 
-  anime::Item* anime_item = AnimeDatabase.FindItem(episode_.anime_id);
+  return found;
+}
+
+bool TaigaFileSearchHelper::OnFileIdentified(const std::wstring& path,
+                                             const anime::Episode& episode) {
+  anime::Item* anime_item = AnimeDatabase.FindItem(episode.anime_id);
 
-  if (anime_item && Meow.IsValidAnimeType(episode_) &&
-                    Meow.IsValidFileExtension(episode_)) {
-    int upper_bound = anime::GetEpisodeHigh(episode_);
-    int lower_bound = anime::GetEpisodeLow(episode_);
+  if (anime_item && Meow.IsValidAnimeType(episode) &&
+                    Meow.IsValidFileExtension(episode)) {
+    int upper_bound = anime::GetEpisodeHigh(episode);
+    int lower_bound = anime::GetEpisodeLow(episode);
 
     if (!anime::IsValidEpisodeNumber(upper_bound, anime_item->GetEpisodeCount()) ||
         !anime::IsValidEpisodeNumber(lower_bound, anime_item->GetEpisodeCount())) {
-      std::wstring episode_number = anime::GetEpisodeRange(episode_);
+      std::wstring episode_number = anime::GetEpisodeRange(episode);
       LOGD(L"Invalid episode number: {}\nFile: {}", episode_number, path);
       return false;
     }
@@ -19,6 +19,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include "base/file.h"
 #include "library/anime_episode.h"
@@ -28,6 +29,9 @@ public:
   TaigaFileSearchHelper();
   ~TaigaFileSearchHelper() {}
 
+  using FileSearchHelper::Search;
+  bool Search(const std::wstring& root);
+
   bool OnDirectory(const std::wstring& root, const std::wstring& name, const WIN32_FIND_DATA& data);
   bool OnFile(const std::wstring& root, const std::wstring& name, const WIN32_FIND_DATA& data);
 
@@ -38,9 +42,16 @@ public:
   void set_path_found(const std::wstring& path_found);
 
 private:
+  // Files are queued and processed in batches, in the order they were found.
+  // Side effects stop at the first file that ends the search, as if each file
+  // had been processed as soon as it was found.
+  bool ProcessFiles();
+  bool OnFileIdentified(const std::wstring& path, const anime::Episode& episode);
+
   int anime_id_;
   anime::Episode episode_;
   int episode_number_;
+  std::vector<std::wstring> files_;
   std::wstring path_found_;
 };
 
@@ -131,11 +131,7 @@ BOOL TorrentDialog::OnCommand(WPARAM wParam, LPARAM lParam) {
     case 100: {
       DlgMain.edit.SetText(L"");
       if (GetKeyState(VK_CONTROL) & 0x8000) {
-        auto feed = Aggregator.GetFeed(FeedCategory::Link);
-        if (feed) {
-          feed->Load();
-          Aggregator.ExamineData(*feed);
-        }
+        Aggregator.LoadFeed(FeedCategory::Link, Settings[taiga::kTorrent_Discovery_Source]);
         RefreshList();
       } else {
         Aggregator.CheckFeed(FeedCategory::Link, Settings[taiga::kTorrent_Discovery_Source]);
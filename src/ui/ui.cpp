@@ -41,7 +41,6 @@
 #include "taiga/settings.h"
 #include "taiga/taiga.h"
 #include "track/media.h"
-#include "track/recognition.h"
 #include "ui/dlg/dlg_anime_info.h"
 #include "ui/dlg/dlg_anime_list.h"
 #include "ui/dlg/dlg_history.h"
@@ -740,10 +739,10 @@ bool OnRecognitionCancelConfirm() {
   return dlg.GetSelectedButtonID() == IDYES;
 }
 
-void OnRecognitionFail() {
+void OnRecognitionFail(const std::vector<std::pair<int, double>>& scores) {
   if (!CurrentEpisode.anime_title().empty()) {
     MediaPlayers.set_title_changed(false);
-    DlgNowPlaying.SetScores(Meow.GetScores());
+    DlgNowPlaying.SetScores(scores);
     DlgNowPlaying.SetCurrentId(anime::ID_NOTINLIST);
     ChangeStatusText(L"Watching: {}{} (Not recognized)"_format(
                      CurrentEpisode.anime_title(),
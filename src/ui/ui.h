@@ -18,6 +18,9 @@
 
 #pragma once
 
+#include <utility>
+#include <vector>
+
 #include <windows/win/taskbar.h>
 
 #include "base/types.h"
@@ -97,7 +100,7 @@ void OnAnimeWatchingStart(const anime::Item& anime_item, const anime::Episode& e
 void OnAnimeWatchingEnd(const anime::Item& anime_item, const anime::Episode& episode);
 
 bool OnRecognitionCancelConfirm();
-void OnRecognitionFail();
+void OnRecognitionFail(const std::vector<std::pair<int, double>>& scores);
 
 void OnAnimeListHeaderRatingWarning();
 